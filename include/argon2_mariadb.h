@@ -1,6 +1,7 @@
 #pragma once
 #include <mysql.h>
 #include "params.h"
+#include "hash.h"
 
 // Defined in params.h
 extern const Argon2MariaDBParams ARGON2_MARIADB_DEFAULT_PARAMS;
@@ -21,13 +22,7 @@ typedef struct ARGON2_state ARGON2_state;
 ARGON2_state *ARGON2_state_malloc();
 void ARGON2_state_free(ARGON2_state *state);
 
-// An encoding option for hash output which can be supplied as an optional
-// third parameter to ARGON2()
-typedef enum {
-	ARGON2_encoding_std = 0,
-	ARGON2_encoding_raw = 1,
-	ARGON2_encoding_hashonly = 2
-} ARGON2_encoding;
+// Encoding options for ARGON2() output are defined in hash.h
 
 int ARGON2_VERIFY_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
 long long ARGON2_VERIFY(UDF_INIT *initid, UDF_ARGS *args,
@@ -37,3 +32,17 @@ void ARGON2_VERIFY_deinit(UDF_INIT *initid);
 typedef struct ARGON2_VERIFY_state ARGON2_VERIFY_state;
 ARGON2_VERIFY_state *ARGON2_VERIFY_state_malloc();
 void ARGON2_VERIFY_state_free(ARGON2_VERIFY_state *state);
+
+// Dump recent phase timings (requires a build with TRACE_RING)
+int ARGON2_TRACE_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+char *ARGON2_TRACE(UDF_INIT *initid, UDF_ARGS *args,
+		char *result, unsigned long *result_len,
+		char *is_null, char *error);
+void ARGON2_TRACE_deinit(UDF_INIT *initid);
+
+// Dump per-class hashing scheduler and memory counters
+int ARGON2_SCHED_STATS_init(UDF_INIT *initid, UDF_ARGS *args, char *message);
+char *ARGON2_SCHED_STATS(UDF_INIT *initid, UDF_ARGS *args,
+		char *result, unsigned long *result_len,
+		char *is_null, char *error);
+void ARGON2_SCHED_STATS_deinit(UDF_INIT *initid);
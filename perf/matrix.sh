@@ -0,0 +1,225 @@
+#!/bin/sh
+# Throughput regression suite over all argon2 static lib variants (see `make perf-matrix`)
+#
+# Usage:
+#	matrix.sh run dir variant... > results.json
+#		Run dir/argon2_mariadb_bench-<variant> -J <variant> for each variant
+#	matrix.sh compare [-u] baseline.json results.json
+#		Compare results against baseline, exiting nonzero on regressions.
+#		Metrics without a recorded baseline value fail, unless -u is given
+#	matrix.sh record baseline.json results.json
+#		Replace the values of baseline with results, keeping tolerances
+#
+# Results are a JSON object with one metric per line:
+#	{"variant": "...", "name": "...", "unit": "ops/s", "value": 123.4}
+# Baselines add a default "tolerance" (fraction of the baseline value) on its own line,
+# which can be overridden per metric with a "tolerance" field.
+# Baselines also hold relations between variants, one per line, which need no recorded values:
+#	{"variant": "argon2-simd", "at_least": "argon2", "prefix": "ARGON2_VERIFY.", "tolerance": 0.1}
+# Each result of variant whose name starts with prefix fails if it is slower than the same result
+# of the at_least variant (in the same run) by more than tolerance.
+# Metrics with a null value (or missing from the baseline) have no recorded baseline,
+# and fail unless compare is given -u.
+set -e
+
+# Extract a field from a metric line, as an empty string if missing
+awk_field='
+function field(line, key,    m) {
+	if (!match(line, "\"" key "\": *(\"[^\"]*\"|[-+0-9.eE]+|null)")) {
+		return ""
+	}
+	m = substr(line, RSTART, RLENGTH)
+	sub(/^"[^"]*": */, "", m)
+	gsub(/"/, "", m)
+	return m
+}
+'
+
+run() {
+	dir=$1
+	shift
+	# Keep server tuning from affecting results
+	unset ARGON2_MARIADB_WARMUP ARGON2_MARIADB_MEMORY_BUDGET \
+		ARGON2_MARIADB_POOL_CORES ARGON2_MARIADB_BATCH_CORES ARGON2_MARIADB_BATCH_MEMORY
+	for variant in "$@"; do
+		"$dir/argon2_mariadb_bench-$variant" -J "$variant" > "$dir/$variant.jsonl"
+	done
+	echo '{"metrics": ['
+	for variant in "$@"; do
+		cat "$dir/$variant.jsonl"
+	done | sed '$!s/$/,/'
+	echo ']}'
+}
+
+compare() {
+	allow_unrecorded=0
+	if [ "$1" = "-u" ]; then
+		allow_unrecorded=1
+		shift
+	fi
+	awk -v allow_unrecorded=$allow_unrecorded "$awk_field"'
+	# Baseline
+	NR == FNR && field($0, "at_least") != "" {
+		relations[++n_relations] = $0
+		next
+	}
+	NR == FNR {
+		if (field($0, "name") == "") {
+			if ((t = field($0, "tolerance")) != "") {
+				tolerance = t
+			}
+			next
+		}
+		key = field($0, "variant") "\t" field($0, "name")
+		keys[++n] = key
+		baseline[key] = field($0, "value")
+		tolerances[key] = field($0, "tolerance")
+		next
+	}
+	# Results
+	field($0, "name") != "" {
+		key = field($0, "variant") "\t" field($0, "name")
+		if (!(key in baseline)) {
+			keys[++n] = key
+			baseline[key] = "null"
+		}
+		results[key] = field($0, "value")
+	}
+	END {
+		printf "%s\t%s\t%s\t%s\t%s\t%s\n", "variant", "name", "baseline", "result", "change", "status"
+		failed = 0
+		for (i = 1; i <= n; i++) {
+			key = keys[i]
+			t = tolerances[key] != "" ? tolerances[key] : tolerance
+			if (!(key in results)) {
+				status = baseline[key] == "null" ? "missing" : "MISSING"
+				printf "%s\t%s\t-\t-\t%s\n", key, baseline[key], status
+				failed += status == "MISSING"
+				continue
+			}
+			if (baseline[key] == "null") {
+				if (allow_unrecorded) {
+					status = "unrecorded"
+				} else {
+					status = "UNRECORDED"
+					unrecorded++
+				}
+				printf "%s\t-\t%s\t-\t%s\n", key, results[key], status
+				continue
+			}
+			change = results[key] / baseline[key] - 1
+			if (change < -t) {
+				status = "REGRESSION"
+				failed++
+			} else if (change > t) {
+				status = "improved"
+			} else {
+				status = "ok"
+			}
+			printf "%s\t%s\t%s\t%+.1f%%\t%s\n", key, baseline[key], results[key], change * 100, status
+		}
+		# Relations between variants
+		for (i = 1; i <= n_relations; i++) {
+			variant = field(relations[i], "variant")
+			other = field(relations[i], "at_least")
+			prefix = field(relations[i], "prefix")
+			t = field(relations[i], "tolerance")
+			if (t == "") {
+				t = tolerance
+			}
+			for (j = 1; j <= n; j++) {
+				key = keys[j]
+				if (!(key in results)) {
+					continue
+				}
+				split(key, parts, "\t")
+				if (parts[1] != variant || substr(parts[2], 1, length(prefix)) != prefix) {
+					continue
+				}
+				other_key = other "\t" parts[2]
+				if (!(other_key in results)) {
+					continue
+				}
+				change = results[key] / results[other_key] - 1
+				if (change < -t) {
+					status = "REGRESSION"
+					failed++
+				} else {
+					status = "ok"
+				}
+				printf "%s>=%s\t%s\t%s\t%s\t%+.1f%%\t%s\n", variant, other, parts[2],
+						results[other_key], results[key], change * 100, status
+			}
+		}
+		if (failed > 0) {
+			printf "%d metric(s) regressed beyond tolerance or are missing\n", failed > "/dev/stderr"
+		}
+		if (unrecorded > 0) {
+			printf "%d metric(s) have no recorded baseline, run make perf-baseline on the reference machine (or set PERF_ALLOW_UNRECORDED=true)\n", unrecorded > "/dev/stderr"
+		}
+		if (failed > 0 || unrecorded > 0) {
+			exit 1
+		}
+	}' "$1" "$2"
+}
+
+record() {
+	baseline=$1
+	tmp="$baseline.tmp"
+	awk "$awk_field"'
+	NR == FNR {
+		if (field($0, "at_least") != "") {
+			line = $0
+			sub(/,$/, "", line)
+			relations[++n_relations] = line
+		} else if (field($0, "name") == "") {
+			if ((t = field($0, "tolerance")) != "") {
+				tolerance = t
+			}
+		} else if ((t = field($0, "tolerance")) != "") {
+			tolerances[field($0, "variant") "\t" field($0, "name")] = t
+		}
+		next
+	}
+	FNR == 1 {
+		print "{"
+		printf "\"tolerance\": %s,\n", tolerance != "" ? tolerance : "0.1"
+		print "\"relations\": ["
+		for (i = 1; i <= n_relations; i++) {
+			print relations[i] (i < n_relations ? "," : "")
+		}
+		print "],"
+		print "\"metrics\": ["
+	}
+	field($0, "name") != "" {
+		key = field($0, "variant") "\t" field($0, "name")
+		line = $0
+		sub(/,$/, "", line)
+		if (key in tolerances) {
+			sub(/}$/, ", \"tolerance\": " tolerances[key] "}", line)
+		}
+		if (prev != "") {
+			print prev ","
+		}
+		prev = line
+	}
+	END {
+		if (prev != "") {
+			print prev
+		}
+		print "]}"
+	}' "$baseline" "$2" > "$tmp"
+	mv "$tmp" "$baseline"
+}
+
+case "$1" in
+run|compare|record)
+	cmd=$1
+	shift
+	"$cmd" "$@"
+	;;
+*)
+	echo "Usage: $0 run dir variant... | compare [-u] baseline results | record baseline results" >&2
+	exit 1
+	;;
+esac
@@ -2,8 +2,11 @@
 #include "argon2.h"
 #include "params.h"
 #include "decode.h"
+#include "hash.h"
+#include "trace.h"
+#include "scheduler.h"
+#include "matrix.h"
 #include <base64.h>
-#include <openssl/crypto.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -17,17 +20,36 @@ struct ARGON2_state {
 	// can't be performed in init, and must be deferred to the main function
 	// (such as when the params argument is a statement placeholder)
 	bool decoded;
+	// Canonical encoding of params, which prefixes every ARGON2_encoding_std result
+	char *encoded_params;
+	size_t encoded_params_len;
 };
 ARGON2_state *ARGON2_state_malloc() {
 	ARGON2_state *state = malloc(sizeof(ARGON2_state));
 	state->params = malloc(sizeof(Argon2MariaDBParams));
+	state->encoded_params = NULL;
 	
 	return state;
 }
 void ARGON2_state_free(ARGON2_state *state) {
 	free(state->params);
+	free(state->encoded_params);
 	free(state);
 }
+// Decode params and cache their canonical encoding.
+// Returns nonzero on failure.
+static int ARGON2_state_decode(ARGON2_state *state, const char *encoded, const size_t encoded_len) {
+	if (Argon2MariaDBParams_decode(state->params, encoded, encoded_len) != 0) {
+		return 1;
+	}
+	state->encoded_params_len = Argon2MariaDBParams_encoded_len(state->params);
+	free(state->encoded_params);
+	state->encoded_params = malloc(state->encoded_params_len);
+	if (state->encoded_params == NULL) {
+		return 1;
+	}
+	return Argon2MariaDBParams_encode(state->params, state->encoded_params, state->encoded_params_len);
+}
 
 struct ARGON2_VERIFY_state {
 	Argon2MariaDBParams *params;
@@ -48,6 +70,21 @@ void ARGON2_VERIFY_state_free(ARGON2_VERIFY_state *state) {
 	free(state);
 }
 
+// Read the optional priority class argument at index i (NULL selects the default class).
+// Returns nonzero if the class is invalid.
+static int read_class_arg(const UDF_ARGS *args, const unsigned int i, Argon2MariaDBClass *class) {
+	*class = ARGON2_MARIADB_CLASS_interactive;
+	if (args->arg_count <= i || args->args[i] == NULL) {
+		return 0;
+	}
+	const long long value = *(long long *)args->args[i];
+	if (value != ARGON2_MARIADB_CLASS_interactive && value != ARGON2_MARIADB_CLASS_batch) {
+		return 1;
+	}
+	*class = value;
+	return 0;
+}
+
 int ARGON2_PARAMS_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
 	// Ensure there are no NULL values or placeholders provided as arguments
 	for (size_t i = 0; i < args->arg_count; i++) {
@@ -104,12 +141,14 @@ int ARGON2_PARAMS_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
 char *ARGON2_PARAMS(UDF_INIT *initid, UDF_ARGS *args,
 		char *result, unsigned long *result_len,
 		char *is_null, char *error) {
+	ARGON2_MARIADB_TRACE_START(ARGON2_PARAMS);
 	Argon2MariaDBParams *params = (Argon2MariaDBParams *)initid->ptr;
 	// Generate a random salt
 	if (Argon2MariaDBParams_gensalt(params) != 0) {
 		*error = 1;
 		return NULL;
 	}
+	ARGON2_MARIADB_TRACE(gensalt);
 
 	// Encode params
 	*result_len = Argon2MariaDBParams_encoded_len(params);
@@ -117,6 +156,8 @@ char *ARGON2_PARAMS(UDF_INIT *initid, UDF_ARGS *args,
 		*error = 1;
 		return NULL;
 	}
+	ARGON2_MARIADB_TRACE(encode);
+	ARGON2_MARIADB_TRACE(done);
 	return result;
 }
 
@@ -131,8 +172,9 @@ int ARGON2_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
 
 	// Validate args
 	ARGON2_encoding encoding = ARGON2_encoding_std;
-	if (args->arg_count < 2 || args->arg_count > 3) {
-		strcpy(message, "ARGON2() requires 2 or 3 arguments");
+	Argon2MariaDBClass class;
+	if (args->arg_count < 2 || args->arg_count > 4) {
+		strcpy(message, "ARGON2() requires 2 to 4 arguments");
 		return 1;
 	}
 	switch (args->arg_count) {
@@ -143,7 +185,18 @@ int ARGON2_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
 			return 1;
 		}
 		break;
-	
+
+	case 4:
+		// The class may vary between rows (i.e when provided as a user variable)
+		if (args->arg_type[3] != INT_RESULT) {
+			strcpy(message, "ARGON2(params, passwd, enc, class) requires 2 strings and 2 ints");
+			return 1;
+		}
+		if (read_class_arg(args, 3, &class) != 0) {
+			strcpy(message, "ARGON2() received invalid class");
+			return 1;
+		}
+		// fallthrough
 	case 3:
 		if (args->arg_type[0] != STRING_RESULT ||
 				args->arg_type[1] != STRING_RESULT ||
@@ -177,7 +230,7 @@ int ARGON2_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
 	if (args->args[0] == NULL) {
 		return 0;
 	}
-	if (Argon2MariaDBParams_decode(state->params, args->args[0], args->lengths[0]) != 0) {
+	if (ARGON2_state_decode(state, args->args[0], args->lengths[0]) != 0) {
 		strcpy(message, "ARGON2() failed to decode params");
 		ARGON2_state_free(state);
 		return 1;
@@ -190,83 +243,41 @@ int ARGON2_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
 char *ARGON2(UDF_INIT *initid, UDF_ARGS *args,
 		char *result, unsigned long *result_len,
 		char *is_null, char *error) {
+	ARGON2_MARIADB_TRACE_START(ARGON2);
 	ARGON2_state *state = (ARGON2_state *)initid->ptr;
 	// Perform late param decoding if needed
 	if (!state->decoded) {
 		if (args->args[0] == NULL ||
-				Argon2MariaDBParams_decode(state->params, args->args[0], args->lengths[0]) != 0) {
+				ARGON2_state_decode(state, args->args[0], args->lengths[0]) != 0) {
 			*error = 1;
 			return NULL;
 		}
 		state->decoded = true;
 	}
+	ARGON2_MARIADB_TRACE(decode);
 	Argon2MariaDBParams *params = state->params;
 	const ARGON2_encoding encoding = args->arg_count > 2 ? *(long long *)args->args[2] : ARGON2_encoding_std;
-
-	// Select argon2 function based on mode
-	int argon2_code;
-	switch (encoding) {
-	case ARGON2_encoding_std:
-	{
-		// Set encoded hash length
-		*result_len = argon2_encodedlen(params->t_cost, params->m_cost, params->parallelism,
-				ARGON2_MARIADB_SALT_LEN, ARGON2_MARIADB_HASH_LEN,
-				params->mode);
-		// Select hash fn
-		Argon2MariaDBParams_encoded_hash_fn hash_encoded;
-		ARGON2_MARIADB_ENCODED_HASHFN(params->mode, hash_encoded);
-		// Run hash fn
-		argon2_code = hash_encoded(params->t_cost, params->m_cost, params->parallelism,
-				args->args[1], args->lengths[1],
-				params->salt, sizeof(params->salt),
-				ARGON2_MARIADB_HASH_LEN,
-				result, *result_len);
-		break;
-	}
-	
-	case ARGON2_encoding_raw:
-	{
-		// Set raw hash length
-		*result_len = ARGON2_MARIADB_HASH_LEN;
-		// Select hash fn
-		Argon2MariaDBParams_raw_hash_fn hash_raw;
-		ARGON2_MARIADB_RAW_HASHFN(params->mode, hash_raw);
-		// Run hash fn
-		argon2_code = hash_raw(params->t_cost, params->m_cost, params->parallelism,
-				args->args[1], args->lengths[1],
-				params->salt, sizeof(params->salt),
-				result, *result_len);
-		break;
+	Argon2MariaDBClass class;
+	if (read_class_arg(args, 3, &class) != 0) {
+		*error = 1;
+		return NULL;
 	}
 
-	case ARGON2_encoding_hashonly:
-		// Set encoded hash length
-		*result_len = argon2_encodedlen(params->t_cost, params->m_cost, params->parallelism,
-				ARGON2_MARIADB_SALT_LEN, ARGON2_MARIADB_HASH_LEN,
-				params->mode);
-		// Select hash fn
-		Argon2MariaDBParams_encoded_hash_fn hash_encoded;
-		ARGON2_MARIADB_ENCODED_HASHFN(params->mode, hash_encoded);
-		// Run hash fn
-		argon2_code = hash_encoded(params->t_cost, params->m_cost, params->parallelism,
-				args->args[1], args->lengths[1],
-				params->salt, sizeof(params->salt),
-				ARGON2_MARIADB_HASH_LEN,
-				result, *result_len);
-		if (argon2_code != ARGON2_OK) {
-			break;
-		}
-		// Extract hash from encoded string
-		char *encoded_hash;
-		size_t encoded_hash_len;
-		argon2_mariadb_extract_hash(result, *result_len, &encoded_hash, &encoded_hash_len);
-		*result_len = encoded_hash_len;
-		result = encoded_hash;
-	}
+	// Wait for a hashing slot
+	argon2_mariadb_sched_acquire(class, params);
+	ARGON2_MARIADB_TRACE(queue);
+	// Hash password and encode result directly from the raw hash
+	size_t hash_len;
+	const int argon2_code = argon2_mariadb_hash(params, state->encoded_params, state->encoded_params_len,
+			args->args[1], args->lengths[1], encoding,
+			result, &hash_len);
+	argon2_mariadb_sched_release(class, params);
 	if (argon2_code != ARGON2_OK) {
 		*error = 1;
 		return NULL;
 	}
+	*result_len = hash_len;
+	ARGON2_MARIADB_TRACE(done);
 
 	return result;
 }
@@ -278,8 +289,8 @@ void ARGON2_deinit(UDF_INIT *initid) {
 
 int ARGON2_VERIFY_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
 	// Validate args
-	if (args->arg_count != 2) {
-		strcpy(message, "ARGON2_VERIFY() requires 2 arguments");
+	if (args->arg_count < 2 || args->arg_count > 3) {
+		strcpy(message, "ARGON2_VERIFY() requires 2 or 3 arguments");
 		return 1;
 	}
 	if (args->arg_type[0] != STRING_RESULT ||
@@ -287,6 +298,12 @@ int ARGON2_VERIFY_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
 		strcpy(message, "ARGON2_VERIFY(hash, passwd) requires 2 strings");
 		return 1;
 	}
+	Argon2MariaDBClass class;
+	if (args->arg_count == 3 &&
+			(args->arg_type[2] != INT_RESULT || read_class_arg(args, 2, &class) != 0)) {
+		strcpy(message, "ARGON2_VERIFY(hash, passwd, class) requires a valid int class");
+		return 1;
+	}
 
 	// Allocate state
 	ARGON2_VERIFY_state *state;
@@ -319,6 +336,7 @@ int ARGON2_VERIFY_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
 
 long long ARGON2_VERIFY(UDF_INIT *initid, UDF_ARGS *args,
 		char *is_null, char *error) {
+	ARGON2_MARIADB_TRACE_START(ARGON2_VERIFY);
 	ARGON2_VERIFY_state *state = (ARGON2_VERIFY_state *)initid->ptr;
 	// Perform late params and/or hash decoding if needed
 	if (!state->params_decoded) {
@@ -337,44 +355,128 @@ long long ARGON2_VERIFY(UDF_INIT *initid, UDF_ARGS *args,
 		}
 		state->hash_decoded = true;
 	}
+	ARGON2_MARIADB_TRACE(decode);
 	Argon2MariaDBParams *params = state->params;
 
-	// Select hash function
-	int (*hash_raw)(const uint32_t t_cost, const uint32_t m_cost, const uint32_t parallelism,
-			const void *pwd, const size_t pwdlen,
-			const void *salt, const size_t saltlen,
-			void *hash, const size_t hashlen);
-	switch (params->mode) {
-	case Argon2_d:
-		;;
-		hash_raw = &argon2d_hash_raw;
-		break;
-	case Argon2_i:
-		;;
-		hash_raw = &argon2i_hash_raw;
-		break;
-	case Argon2_id:
-		;;
-		hash_raw = &argon2id_hash_raw;
-	}
-
-	// Hash provided password using params
-	unsigned char input_hash[ARGON2_MARIADB_HASH_LEN];
-	int code = hash_raw(params->t_cost, params->m_cost, params->parallelism,
-			args->args[1], args->lengths[1],
-			params->salt, sizeof(params->salt),
-			input_hash, sizeof(input_hash));
-	if (code != ARGON2_OK) {
+	Argon2MariaDBClass class;
+	if (read_class_arg(args, 2, &class) != 0) {
 		*error = 1;
 		return 0;
 	}
-	// Compare hash result with correct hash
-	if (CRYPTO_memcmp(input_hash, state->hash, sizeof(state->hash)) != 0) {
-		return 0; // hashes are not equal -> return false
+
+	// Wait for a hashing slot
+	argon2_mariadb_sched_acquire(class, params);
+	ARGON2_MARIADB_TRACE(queue);
+	// Hash provided password using params and compare with correct hash
+	bool match;
+	const int argon2_code = argon2_mariadb_verify(params, state->hash, sizeof(state->hash),
+			args->args[1], args->lengths[1], &match);
+	argon2_mariadb_sched_release(class, params);
+	if (argon2_code != ARGON2_OK) {
+		*error = 1;
+		return 0;
 	}
-	return 1; // hashes are equal -> return true
+	ARGON2_MARIADB_TRACE(done);
+	return match; // 1 if hashes are equal, 0 otherwise
 }
 
 void ARGON2_VERIFY_deinit(UDF_INIT *initid) {
 	ARGON2_VERIFY_state_free((ARGON2_VERIFY_state *)initid->ptr);
 }
+
+// Max length of ARGON2_TRACE() output, longer dumps are truncated
+#define ARGON2_TRACE_MAX_LEN (1 << 24)
+// Last line of truncated ARGON2_TRACE() output
+#define ARGON2_TRACE_TRUNCATED "truncated\n"
+
+int ARGON2_TRACE_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+	if (args->arg_count != 0) {
+		strcpy(message, "ARGON2_TRACE() requires 0 arguments");
+		return 1;
+	}
+#ifndef ARGON2_MARIADB_TRACE_RING
+	strcpy(message, "ARGON2_TRACE() requires a build with TRACE_RING");
+	return 1;
+#endif
+	// Output is larger than the default result buffer, and is allocated once the number of rings is known
+	initid->max_length = ARGON2_TRACE_MAX_LEN;
+	initid->ptr = NULL;
+	return 0;
+}
+
+char *ARGON2_TRACE(UDF_INIT *initid, UDF_ARGS *args,
+		char *result, unsigned long *result_len,
+		char *is_null, char *error) {
+	// Room for every ring, the truncation marker, and the null terminator written by fmemopen()
+	size_t dump_len = argon2_mariadb_trace_dump_max_len();
+	if (dump_len > ARGON2_TRACE_MAX_LEN - sizeof(ARGON2_TRACE_TRUNCATED)) {
+		dump_len = ARGON2_TRACE_MAX_LEN - sizeof(ARGON2_TRACE_TRUNCATED);
+	}
+	char *buf = realloc(initid->ptr, dump_len + sizeof(ARGON2_TRACE_TRUNCATED));
+	if (buf == NULL) {
+		*error = 1;
+		return NULL;
+	}
+	initid->ptr = buf;
+	FILE *f = fmemopen(buf, dump_len + 1, "w");
+	if (f == NULL) {
+		*error = 1;
+		return NULL;
+	}
+	// Disable buffering so output is truncated (rather than discarded) once the buffer is full
+	setvbuf(f, NULL, _IONBF, 0);
+	argon2_mariadb_trace_dump(f);
+	const bool truncated = ferror(f);
+	size_t len = ftell(f);
+	fclose(f);
+	if (len > dump_len) {
+		len = dump_len;
+	}
+	if (truncated) {
+		// Drop the partial last line (rings allocated during the dump, or past ARGON2_TRACE_MAX_LEN)
+		while (len > 0 && buf[len-1] != '\n') {
+			len--;
+		}
+		memcpy(buf + len, ARGON2_TRACE_TRUNCATED, sizeof(ARGON2_TRACE_TRUNCATED) - 1);
+		len += sizeof(ARGON2_TRACE_TRUNCATED) - 1;
+	}
+	*result_len = len;
+	return buf;
+}
+
+void ARGON2_TRACE_deinit(UDF_INIT *initid) {
+	free(initid->ptr);
+}
+
+// Max length of ARGON2_SCHED_STATS() output
+#define ARGON2_SCHED_STATS_MAX_LEN 512
+
+int ARGON2_SCHED_STATS_init(UDF_INIT *initid, UDF_ARGS *args, char *message) {
+	if (args->arg_count != 0) {
+		strcpy(message, "ARGON2_SCHED_STATS() requires 0 arguments");
+		return 1;
+	}
+	// Output may be larger than the default result buffer
+	initid->max_length = ARGON2_SCHED_STATS_MAX_LEN;
+	initid->ptr = malloc(ARGON2_SCHED_STATS_MAX_LEN);
+	if (initid->ptr == NULL) {
+		strcpy(message, "ARGON2_SCHED_STATS() failed to allocate memory");
+		return 1;
+	}
+	return 0;
+}
+
+char *ARGON2_SCHED_STATS(UDF_INIT *initid, UDF_ARGS *args,
+		char *result, unsigned long *result_len,
+		char *is_null, char *error) {
+	size_t len = argon2_mariadb_sched_stats(initid->ptr, ARGON2_SCHED_STATS_MAX_LEN);
+	if (len < ARGON2_SCHED_STATS_MAX_LEN) {
+		len += argon2_mariadb_matrix_stats(initid->ptr + len, ARGON2_SCHED_STATS_MAX_LEN - len);
+	}
+	*result_len = len < ARGON2_SCHED_STATS_MAX_LEN ? len : ARGON2_SCHED_STATS_MAX_LEN - 1;
+	return initid->ptr;
+}
+
+void ARGON2_SCHED_STATS_deinit(UDF_INIT *initid) {
+	free(initid->ptr);
+}
@@ -0,0 +1,445 @@
+#include "argon2_mariadb.h"
+#include "params.h"
+#include "hash.h"
+#include "decode.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+// argon2_mariadb_bench: benchmark ARGON2() the way a high row count
+// INSERT ... SELECT ARGON2(@params, password, encoding) FROM ... statement calls it
+// (init once with constant params, then once per row), along with the output encoding stage alone.
+// With -c, also run ARGON2_VERIFY() from concurrent clients, reporting latency and peak RSS.
+// With -J, run the fixed regression workload instead, printing results as JSON lines (see perf/matrix.sh).
+
+#define BENCH_DEFAULT_ROWS 256
+#define BENCH_ENCODE_ROWS 1000000
+// Size of the result buffer provided by the server
+#define BENCH_RESULT_LEN 255
+
+static const char *const encoding_names[] = {"std", "raw", "hashonly"};
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run ARGON2(params, password, encoding) over n_rows rows, returns rows/s or a negative value on failure
+static double bench_argon2(const char *params, const size_t params_len,
+		const ARGON2_encoding encoding, const size_t n_rows) {
+	long long enc = encoding;
+	char passwd[32];
+	enum Item_result arg_types[] = {STRING_RESULT, STRING_RESULT, INT_RESULT};
+	char *arg_values[] = {(char *)params, passwd, (char *)&enc};
+	unsigned long arg_lengths[] = {params_len, 0, sizeof(enc)};
+	UDF_ARGS args = {
+		.arg_count = 3,
+		.arg_type = arg_types,
+		.args = arg_values,
+		.lengths = arg_lengths
+	};
+	UDF_INIT initid = {0};
+	char message[512];
+	if (ARGON2_init(&initid, &args, message) != 0) {
+		fprintf(stderr, "ARGON2_init: %s\n", message);
+		return -1;
+	}
+
+	char result[BENCH_RESULT_LEN];
+	unsigned long result_len;
+	char is_null = 0, error = 0;
+	const double start = now();
+	for (size_t i = 0; i < n_rows; i++) {
+		arg_lengths[1] = snprintf(passwd, sizeof(passwd), "password%zu", i);
+		if (ARGON2(&initid, &args, result, &result_len, &is_null, &error) == NULL || error) {
+			ARGON2_deinit(&initid);
+			return -1;
+		}
+	}
+	const double t = now() - start;
+	ARGON2_deinit(&initid);
+	return n_rows / t;
+}
+
+// Run the output encoding stage alone, returns ns/row
+static double bench_encode(const char *params, const size_t params_len,
+		const ARGON2_encoding encoding, const size_t n_rows) {
+	unsigned char hash[ARGON2_MARIADB_HASH_LEN] = {0};
+	char result[BENCH_RESULT_LEN];
+	const size_t result_len = argon2_mariadb_encoded_len(params_len, encoding);
+	const double start = now();
+	for (size_t i = 0; i < n_rows; i++) {
+		hash[i % sizeof(hash)] ^= i;
+		argon2_mariadb_encode(params, params_len, hash, encoding, result, result_len);
+		// Keep the result live
+		__asm__ volatile("" : : "r"(result) : "memory");
+	}
+	return (now() - start) * 1e9 / n_rows;
+}
+
+typedef struct {
+	const char *hash;
+	size_t hash_len;
+	size_t n_rows;
+	double *latencies; // Seconds per call
+	int status;
+} BenchClient;
+
+// Run ARGON2_VERIFY(hash, password) as a single client
+static void *bench_verify_client(void *arg) {
+	BenchClient *client = arg;
+	const char passwd[] = "password";
+	enum Item_result arg_types[] = {STRING_RESULT, STRING_RESULT};
+	char *arg_values[] = {(char *)client->hash, (char *)passwd};
+	unsigned long arg_lengths[] = {client->hash_len, sizeof(passwd) - 1};
+	UDF_ARGS args = {
+		.arg_count = 2,
+		.arg_type = arg_types,
+		.args = arg_values,
+		.lengths = arg_lengths
+	};
+	UDF_INIT initid = {0};
+	char message[512];
+	if (ARGON2_VERIFY_init(&initid, &args, message) != 0) {
+		fprintf(stderr, "ARGON2_VERIFY_init: %s\n", message);
+		client->status = 1;
+		return NULL;
+	}
+	char is_null = 0, error = 0;
+	for (size_t i = 0; i < client->n_rows; i++) {
+		const double start = now();
+		if (ARGON2_VERIFY(&initid, &args, &is_null, &error) != 1 || error) {
+			client->status = 1;
+			break;
+		}
+		client->latencies[i] = now() - start;
+	}
+	ARGON2_VERIFY_deinit(&initid);
+	return NULL;
+}
+
+static int compare_double(const void *a, const void *b) {
+	const double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// Run ARGON2_VERIFY() from n_clients concurrent clients, n_rows calls each
+static int bench_verify_concurrent(const char *params, const size_t params_len,
+		const size_t n_clients, const size_t n_rows) {
+	// Hash the password verified by clients
+	Argon2MariaDBParams decoded;
+	char hash[BENCH_RESULT_LEN];
+	size_t hash_len;
+	if (Argon2MariaDBParams_decode(&decoded, params, params_len) != 0 ||
+			argon2_mariadb_hash(&decoded, params, params_len, "password", sizeof("password") - 1,
+				ARGON2_encoding_std, hash, &hash_len) != ARGON2_OK) {
+		return 1;
+	}
+
+	BenchClient clients[n_clients];
+	pthread_t threads[n_clients];
+	double *latencies = malloc(n_clients * n_rows * sizeof(double));
+	const double start = now();
+	for (size_t i = 0; i < n_clients; i++) {
+		clients[i] = (BenchClient){
+			.hash = hash,
+			.hash_len = hash_len,
+			.n_rows = n_rows,
+			.latencies = latencies + i * n_rows
+		};
+		pthread_create(&threads[i], NULL, bench_verify_client, &clients[i]);
+	}
+	int status = 0;
+	for (size_t i = 0; i < n_clients; i++) {
+		pthread_join(threads[i], NULL);
+		status |= clients[i].status;
+	}
+	const double t = now() - start;
+	if (status != 0) {
+		printf("ARGON2_VERIFY() x %zu clients: failed\n", n_clients);
+		free(latencies);
+		return status;
+	}
+
+	const size_t n = n_clients * n_rows;
+	qsort(latencies, n, sizeof(double), compare_double);
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	printf("ARGON2_VERIFY() x %zu clients: %.1f rows/s, p50: %.1fms, p99: %.1fms, max: %.1fms, peak RSS: %ldMiB\n",
+			n_clients, n / t, latencies[n / 2] * 1e3, latencies[n * 99 / 100] * 1e3, latencies[n - 1] * 1e3,
+			usage.ru_maxrss / 1024);
+	free(latencies);
+	return 0;
+}
+
+// Fixed regression workload (-J). Changing it invalidates perf/baseline.json.
+// Each measurement is repeated, keeping the best throughput to reduce noise.
+#define PERF_REPEAT 3
+#define PERF_CODEC_OPS 200000
+#define PERF_PARAMS_OPS 20000
+#define PERF_ARGON2_ROWS 32
+
+// ARGON2_VERIFY() points, all in argon2id mode with t_cost = 3
+static const struct {
+	uint32_t m_cost;
+	uint32_t parallelism;
+	size_t n_rows;
+} perf_verify_points[] = {
+	{1 << 12, 1, 64}, // ARGON2_MARIADB_MIN_PARAMS
+	{1 << 16, 1, 8},
+	{1 << 16, 4, 8} // ARGON2_MARIADB_DEFAULT_PARAMS (threaded builds)
+};
+
+typedef struct {
+	Argon2MariaDBParams params;
+	const char *encoded; // Encoded params or hash
+	size_t encoded_len;
+	char result[BENCH_RESULT_LEN];
+	UDF_INIT initid;
+	UDF_ARGS args;
+} PerfCtx;
+
+// Operation measured by perf_measure(), returns nonzero on failure
+typedef int (*PerfOp)(PerfCtx *ctx, const size_t i);
+
+static int perf_params_encode(PerfCtx *ctx, const size_t i) {
+	ctx->params.salt[0] = i;
+	return Argon2MariaDBParams_encode(&ctx->params, ctx->result, ctx->encoded_len);
+}
+static int perf_params_decode(PerfCtx *ctx, const size_t i) {
+	return Argon2MariaDBParams_decode(&ctx->params, ctx->encoded, ctx->encoded_len);
+}
+static int perf_hash_extract(PerfCtx *ctx, const size_t i) {
+	char *hash;
+	size_t hash_len;
+	argon2_mariadb_extract_hash(ctx->encoded, ctx->encoded_len, &hash, &hash_len);
+	return hash_len == 0;
+}
+static int perf_hash_decode(PerfCtx *ctx, const size_t i) {
+	return argon2_mariadb_decode_hash(ctx->encoded, ctx->encoded_len,
+			(unsigned char *)ctx->result, ARGON2_MARIADB_HASH_LEN);
+}
+static int perf_udf_params(PerfCtx *ctx, const size_t i) {
+	unsigned long result_len;
+	char is_null = 0, error = 0;
+	return ARGON2_PARAMS(&ctx->initid, &ctx->args, ctx->result, &result_len, &is_null, &error) == NULL || error;
+}
+static int perf_udf_argon2(PerfCtx *ctx, const size_t i) {
+	char passwd[32];
+	ctx->args.args[1] = passwd;
+	ctx->args.lengths[1] = snprintf(passwd, sizeof(passwd), "password%zu", i);
+	unsigned long result_len;
+	char is_null = 0, error = 0;
+	return ARGON2(&ctx->initid, &ctx->args, ctx->result, &result_len, &is_null, &error) == NULL || error;
+}
+static int perf_udf_verify(PerfCtx *ctx, const size_t i) {
+	char is_null = 0, error = 0;
+	return ARGON2_VERIFY(&ctx->initid, &ctx->args, &is_null, &error) != 1 || error;
+}
+
+// Run op n_ops times, PERF_REPEAT times over. Returns the best ops/s, or a negative value on failure
+static double perf_measure(PerfOp op, PerfCtx *ctx, const size_t n_ops) {
+	double best = 0;
+	for (int r = 0; r < PERF_REPEAT; r++) {
+		const double start = now();
+		for (size_t i = 0; i < n_ops; i++) {
+			if (op(ctx, i) != 0) {
+				return -1;
+			}
+			// Keep results live
+			__asm__ volatile("" : : "r"(ctx->result) : "memory");
+		}
+		const double ops_per_sec = n_ops / (now() - start);
+		if (ops_per_sec > best) {
+			best = ops_per_sec;
+		}
+	}
+	return best;
+}
+
+static int perf_report(const char *variant, const char *name, const double ops_per_sec) {
+	if (ops_per_sec < 0) {
+		fprintf(stderr, "%s: %s failed\n", variant, name);
+		return 1;
+	}
+	printf("{\"variant\": \"%s\", \"name\": \"%s\", \"unit\": \"ops/s\", \"value\": %.1f}\n",
+			variant, name, ops_per_sec);
+	fflush(stdout);
+	return 0;
+}
+
+// Run the fixed regression workload, reporting results for variant
+static int bench_perf(const char *variant) {
+	int status = 0;
+	char name[64];
+	PerfCtx ctx = {0};
+
+	// PHC string codec
+	ctx.params = ARGON2_MARIADB_DEFAULT_PARAMS;
+	const size_t params_len = Argon2MariaDBParams_encoded_len(&ctx.params);
+	char encoded_params[params_len];
+	Argon2MariaDBParams_encode(&ctx.params, encoded_params, params_len);
+	ctx.encoded = encoded_params;
+	ctx.encoded_len = params_len;
+	status |= perf_report(variant, "codec.params_encode", perf_measure(perf_params_encode, &ctx, PERF_CODEC_OPS));
+	status |= perf_report(variant, "codec.params_decode", perf_measure(perf_params_decode, &ctx, PERF_CODEC_OPS));
+	char hash[BENCH_RESULT_LEN];
+	size_t hash_len;
+	if (argon2_mariadb_hash(&ctx.params, encoded_params, params_len, "password", sizeof("password") - 1,
+				ARGON2_encoding_std, hash, &hash_len) != ARGON2_OK) {
+		hash_len = 0;
+	}
+	ctx.encoded = hash;
+	ctx.encoded_len = hash_len;
+	status |= perf_report(variant, "codec.hash_extract", perf_measure(perf_hash_extract, &ctx, PERF_CODEC_OPS));
+	status |= perf_report(variant, "codec.hash_decode", perf_measure(perf_hash_decode, &ctx, PERF_CODEC_OPS));
+
+	// ARGON2_PARAMS() (default params)
+	char message[512];
+	ctx.initid = (UDF_INIT){0};
+	ctx.args = (UDF_ARGS){0};
+	if (ARGON2_PARAMS_init(&ctx.initid, &ctx.args, message) != 0) {
+		fprintf(stderr, "ARGON2_PARAMS_init: %s\n", message);
+		return 1;
+	}
+	status |= perf_report(variant, "ARGON2_PARAMS", perf_measure(perf_udf_params, &ctx, PERF_PARAMS_OPS));
+	ARGON2_PARAMS_deinit(&ctx.initid);
+
+	// ARGON2(params, password, encoding) for each encoding, using ARGON2_MARIADB_MIN_PARAMS in argon2id mode
+	Argon2MariaDBParams params = ARGON2_MARIADB_MIN_PARAMS;
+	params.mode = Argon2_id;
+	if (Argon2MariaDBParams_gensalt(&params) != 0) {
+		return 1;
+	}
+	const size_t min_params_len = Argon2MariaDBParams_encoded_len(&params);
+	char min_params[min_params_len];
+	Argon2MariaDBParams_encode(&params, min_params, min_params_len);
+	for (ARGON2_encoding encoding = ARGON2_encoding_std; encoding <= ARGON2_encoding_hashonly; encoding++) {
+		long long enc = encoding;
+		enum Item_result arg_types[] = {STRING_RESULT, STRING_RESULT, INT_RESULT};
+		char *arg_values[] = {min_params, NULL, (char *)&enc};
+		unsigned long arg_lengths[] = {min_params_len, 0, sizeof(enc)};
+		ctx.initid = (UDF_INIT){0};
+		ctx.args = (UDF_ARGS){
+			.arg_count = 3,
+			.arg_type = arg_types,
+			.args = arg_values,
+			.lengths = arg_lengths
+		};
+		if (ARGON2_init(&ctx.initid, &ctx.args, message) != 0) {
+			fprintf(stderr, "ARGON2_init: %s\n", message);
+			return 1;
+		}
+		snprintf(name, sizeof(name), "ARGON2.%s", encoding_names[encoding]);
+		status |= perf_report(variant, name, perf_measure(perf_udf_argon2, &ctx, PERF_ARGON2_ROWS));
+		ARGON2_deinit(&ctx.initid);
+	}
+
+	// ARGON2_VERIFY(hash, password) at each point
+	for (size_t p = 0; p < sizeof(perf_verify_points) / sizeof(perf_verify_points[0]); p++) {
+		params.t_cost = 3;
+		params.m_cost = perf_verify_points[p].m_cost;
+		params.parallelism = perf_verify_points[p].parallelism;
+		const size_t point_params_len = Argon2MariaDBParams_encoded_len(&params);
+		char point_params[point_params_len];
+		Argon2MariaDBParams_encode(&params, point_params, point_params_len);
+		if (argon2_mariadb_hash(&params, point_params, point_params_len, "password", sizeof("password") - 1,
+					ARGON2_encoding_std, hash, &hash_len) != ARGON2_OK) {
+			return 1;
+		}
+		enum Item_result arg_types[] = {STRING_RESULT, STRING_RESULT};
+		char *arg_values[] = {hash, "password"};
+		unsigned long arg_lengths[] = {hash_len, sizeof("password") - 1};
+		ctx.initid = (UDF_INIT){0};
+		ctx.args = (UDF_ARGS){
+			.arg_count = 2,
+			.arg_type = arg_types,
+			.args = arg_values,
+			.lengths = arg_lengths
+		};
+		if (ARGON2_VERIFY_init(&ctx.initid, &ctx.args, message) != 0) {
+			fprintf(stderr, "ARGON2_VERIFY_init: %s\n", message);
+			return 1;
+		}
+		snprintf(name, sizeof(name), "ARGON2_VERIFY.m%u.p%u", params.m_cost, params.parallelism);
+		status |= perf_report(variant, name, perf_measure(perf_udf_verify, &ctx, perf_verify_points[p].n_rows));
+		ARGON2_VERIFY_deinit(&ctx.initid);
+	}
+
+	return status;
+}
+
+int main(int argc, char **argv) {
+	size_t n_rows = BENCH_DEFAULT_ROWS;
+	size_t n_clients = 0;
+	const char *perf_variant = NULL;
+	Argon2MariaDBParams params = ARGON2_MARIADB_MIN_PARAMS;
+	params.mode = Argon2_id;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:t:m:p:c:J:")) != -1) {
+		switch (opt) {
+		case 'n':
+			n_rows = atol(optarg);
+			break;
+		case 't':
+			params.t_cost = atol(optarg);
+			break;
+		case 'm':
+			params.m_cost = atol(optarg);
+			break;
+		case 'p':
+			params.parallelism = atol(optarg);
+			break;
+		case 'c':
+			n_clients = atol(optarg);
+			break;
+		case 'J':
+			perf_variant = optarg;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n rows] [-t t_cost] [-m m_cost] [-p parallelism] [-c clients] [-J variant]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (perf_variant != NULL) {
+		return bench_perf(perf_variant);
+	}
+	if (Argon2MariaDBParams_validate(&params) != 0 || Argon2MariaDBParams_gensalt(&params) != 0) {
+		fprintf(stderr, "invalid params\n");
+		return 1;
+	}
+	const size_t params_len = Argon2MariaDBParams_encoded_len(&params);
+	char encoded_params[params_len + 1];
+	Argon2MariaDBParams_encode(&params, encoded_params, params_len);
+	encoded_params[params_len] = '\0';
+	printf("params: %s, rows: %zu\n", encoded_params, n_rows);
+
+	int status = 0;
+	for (ARGON2_encoding encoding = ARGON2_encoding_std; encoding <= ARGON2_encoding_hashonly; encoding++) {
+		const double rows_per_sec = bench_argon2(encoded_params, params_len, encoding, n_rows);
+		const double encode_ns = bench_encode(encoded_params, params_len, encoding, BENCH_ENCODE_ROWS);
+		if (rows_per_sec < 0) {
+			printf("ARGON2(%s): failed\n", encoding_names[encoding]);
+			status = 1;
+			continue;
+		}
+		printf("ARGON2(%s): %.1f rows/s, encode: %.1f ns/row\n",
+				encoding_names[encoding], rows_per_sec, encode_ns);
+	}
+
+	if (n_clients > 0) {
+		// Each client makes enough calls for a meaningful p99
+		const size_t client_rows = (n_rows + n_clients - 1) / n_clients;
+		status |= bench_verify_concurrent(encoded_params, params_len, n_clients,
+				client_rows < 100 / n_clients + 1 ? 100 / n_clients + 1 : client_rows);
+	}
+
+	return status;
+}
@@ -0,0 +1,546 @@
+#include "params.h"
+#include "decode.h"
+#include "hash.h"
+#include "trace.h"
+#include <argon2.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// argon2_mariadb_bulk: offline parallel ARGON2()/ARGON2_VERIFY() over TSV/CSV input.
+//
+// Each input line has the form [key<delim>]params<delim>password (or hash<delim>password when verifying).
+// The params (or hash) field is located by counting its '$' separators, so passwords
+// may freely contain the delimiter and need no quoting. Output lines have the form
+// [key<delim>]result, in input order, ready for LOAD DATA. Rows that fail to decode or hash
+// are written as \N (NULL).
+//
+// Input is streamed through a bounded window of batches:
+// the main thread fills batches, worker threads claim rows from any in-flight batch,
+// and a writer thread flushes completed batches in order. Memory use is bounded by
+// the window size regardless of input size (lines are read into buffers of at most BULK_MAX_LINE_LEN).
+
+#define BULK_DEFAULT_BATCH_ROWS 256
+// Longest accepted input line, the rest of longer lines is discarded and they are written as NULL
+#define BULK_MAX_LINE_LEN (1 << 16)
+// Initial line buffer size
+#define BULK_MIN_LINE_CAP 128
+// Enough for any encoded hash, or a hex encoded raw hash
+#define BULK_MAX_RESULT_LEN 256
+
+typedef struct {
+	char *line;
+	size_t line_cap;
+	size_t line_len;
+	bool too_long; // The line exceeded BULK_MAX_LINE_LEN and was truncated
+	// Result (without key), valid once the row is done
+	char result[BULK_MAX_RESULT_LEN];
+	size_t result_len;
+	bool failed;
+} BulkRow;
+
+typedef struct {
+	BulkRow *rows;
+	size_t n_rows;
+	size_t next_row; // Next row to be claimed by a worker
+	size_t done_rows; // Rows completed by workers
+} BulkBatch;
+
+typedef struct {
+	// Options
+	ARGON2_encoding encoding;
+	bool verify;
+	bool key;
+	bool progress;
+	bool trace;
+	char delim;
+	size_t batch_rows;
+	FILE *in, *out;
+
+	// Window of batches [head, tail) in flight, indexed modulo window_len
+	BulkBatch *window;
+	size_t window_len;
+	size_t head, tail;
+	bool eof;
+	pthread_mutex_t lock;
+	pthread_cond_t filled; // Signaled when a batch is filled or EOF is reached
+	pthread_cond_t done; // Signaled when a batch is completed
+	pthread_cond_t freed; // Signaled when a batch is written and can be refilled
+	bool write_failed; // Set by the writer when output fails, stops reading and hashing
+
+	// Stats (written only by the writer thread)
+	size_t rows_written, rows_failed;
+	struct timespec start;
+} Bulk;
+
+static double elapsed(const struct timespec *start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Find the delimiter following the n_dollar'th '$' of s, i.e the end of a params or hash field.
+// Returns the offset of the delimiter, or -1 if not found.
+static ssize_t field_end(const char *s, const size_t s_len, const char delim, int n_dollar) {
+	size_t i = 0;
+	for (; i < s_len && n_dollar > 0; i++) {
+		if (s[i] == '$') {
+			n_dollar--;
+		}
+	}
+	for (; i < s_len; i++) {
+		if (s[i] == delim) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void hex_encode(const unsigned char *src, const size_t src_len, char *dst) {
+	static const char digits[] = "0123456789abcdef";
+	for (size_t i = 0; i < src_len; i++) {
+		dst[2*i] = digits[src[i] >> 4];
+		dst[2*i + 1] = digits[src[i] & 0xf];
+	}
+}
+
+// Split row into key, params/hash, and password.
+// Returns nonzero if the row is malformed.
+static int bulk_split(const Bulk *bulk, const BulkRow *row,
+		size_t *field_offset, size_t *field_len, size_t *pwd_offset) {
+	*field_offset = 0;
+	if (bulk->key) {
+		const char *key_end = memchr(row->line, bulk->delim, row->line_len);
+		if (key_end == NULL) {
+			return 1;
+		}
+		*field_offset = key_end - row->line + 1;
+	}
+	// Params have the form $mode$v=..$m=..,t=..,p=..$salt, hashes have an additional $hash
+	const int n_dollar = bulk->verify ? 5 : 4;
+	const ssize_t end = field_end(row->line + *field_offset, row->line_len - *field_offset,
+			bulk->delim, n_dollar);
+	if (end < 0) {
+		return 1;
+	}
+	*field_len = end;
+	*pwd_offset = *field_offset + end + 1;
+	return 0;
+}
+
+static void bulk_process_row(const Bulk *bulk, BulkRow *row) {
+	if (bulk->verify) {
+		ARGON2_MARIADB_TRACE_START(ARGON2_VERIFY);
+	} else {
+		ARGON2_MARIADB_TRACE_START(ARGON2);
+	}
+	row->failed = true;
+	if (row->too_long) {
+		return;
+	}
+	size_t field_offset, field_len, pwd_offset;
+	if (bulk_split(bulk, row, &field_offset, &field_len, &pwd_offset) != 0) {
+		return;
+	}
+	const char *field = row->line + field_offset;
+	const char *pwd = row->line + pwd_offset;
+	const size_t pwd_len = row->line_len - pwd_offset;
+
+	Argon2MariaDBParams params;
+	if (Argon2MariaDBParams_decode(&params, field, field_len) != 0 ||
+			Argon2MariaDBParams_validate(&params) != 0) {
+		return;
+	}
+
+	if (bulk->verify) {
+		unsigned char hash[ARGON2_MARIADB_HASH_LEN];
+		if (argon2_mariadb_decode_hash(field, field_len, hash, sizeof(hash)) != 0) {
+			return;
+		}
+		ARGON2_MARIADB_TRACE(decode);
+		bool match;
+		if (argon2_mariadb_verify(&params, hash, sizeof(hash), pwd, pwd_len, &match) != ARGON2_OK) {
+			return;
+		}
+		row->result[0] = match ? '1' : '0';
+		row->result_len = 1;
+		row->failed = false;
+		ARGON2_MARIADB_TRACE(done);
+		return;
+	}
+	ARGON2_MARIADB_TRACE(decode);
+
+	// Encode params canonically for use as the prefix of std encoded hashes
+	char encoded_params[BULK_MAX_RESULT_LEN];
+	const size_t encoded_params_len = Argon2MariaDBParams_encoded_len(&params);
+	if (argon2_mariadb_encoded_len(encoded_params_len, bulk->encoding) > sizeof(row->result) ||
+			Argon2MariaDBParams_encode(&params, encoded_params, encoded_params_len) != 0) {
+		return;
+	}
+
+	if (bulk->encoding == ARGON2_encoding_raw) {
+		// Raw hashes are hex encoded for use with LOAD DATA ... SET col = UNHEX(@col)
+		unsigned char hash[ARGON2_MARIADB_HASH_LEN];
+		if (argon2_mariadb_hash_raw(&params, pwd, pwd_len, hash, sizeof(hash)) != ARGON2_OK) {
+			return;
+		}
+		hex_encode(hash, sizeof(hash), row->result);
+		row->result_len = 2 * sizeof(hash);
+		ARGON2_MARIADB_TRACE(encode);
+	} else if (argon2_mariadb_hash(&params, encoded_params, encoded_params_len,
+				pwd, pwd_len, bulk->encoding,
+				row->result, &row->result_len) != ARGON2_OK) {
+		return;
+	}
+	row->failed = false;
+	ARGON2_MARIADB_TRACE(done);
+}
+
+static void *bulk_worker(void *arg) {
+	Bulk *bulk = arg;
+	pthread_mutex_lock(&bulk->lock);
+	for (;;) {
+		// Claim the oldest unclaimed row of any in-flight batch
+		BulkBatch *batch = NULL;
+		for (size_t i = bulk->head; i < bulk->tail; i++) {
+			BulkBatch *b = &bulk->window[i % bulk->window_len];
+			if (b->next_row < b->n_rows) {
+				batch = b;
+				break;
+			}
+		}
+		if (batch == NULL) {
+			if (bulk->eof) {
+				break;
+			}
+			pthread_cond_wait(&bulk->filled, &bulk->lock);
+			continue;
+		}
+		BulkRow *row = &batch->rows[batch->next_row++];
+
+		if (bulk->write_failed) {
+			// Output is lost anyway, drain the window without hashing
+			row->failed = true;
+		} else {
+			pthread_mutex_unlock(&bulk->lock);
+			bulk_process_row(bulk, row);
+			pthread_mutex_lock(&bulk->lock);
+		}
+
+		if (++batch->done_rows == batch->n_rows) {
+			pthread_cond_signal(&bulk->done);
+		}
+	}
+	pthread_mutex_unlock(&bulk->lock);
+	return NULL;
+}
+
+static void bulk_write_row(Bulk *bulk, const BulkRow *row) {
+	if (bulk->key) {
+		const char *key_end = memchr(row->line, bulk->delim, row->line_len);
+		if (key_end != NULL) {
+			fwrite(row->line, 1, key_end - row->line, bulk->out);
+		} else {
+			// Without a delimiter there is no key, and the line may hold a password
+			fputs("\\N", bulk->out);
+		}
+		fputc(bulk->delim, bulk->out);
+	}
+	if (row->failed) {
+		fputs("\\N", bulk->out);
+		bulk->rows_failed++;
+	} else {
+		fwrite(row->result, 1, row->result_len, bulk->out);
+	}
+	fputc('\n', bulk->out);
+	bulk->rows_written++;
+}
+
+static void *bulk_writer(void *arg) {
+	Bulk *bulk = arg;
+	double last_report = 0;
+	pthread_mutex_lock(&bulk->lock);
+	for (;;) {
+		// Wait for the oldest batch to complete
+		BulkBatch *batch = &bulk->window[bulk->head % bulk->window_len];
+		if (bulk->head == bulk->tail || batch->done_rows < batch->n_rows) {
+			if (bulk->eof && bulk->head == bulk->tail) {
+				break;
+			}
+			pthread_cond_wait(bulk->head == bulk->tail ? &bulk->filled : &bulk->done, &bulk->lock);
+			continue;
+		}
+		const bool write_failed = bulk->write_failed;
+		pthread_mutex_unlock(&bulk->lock);
+
+		if (write_failed) {
+			pthread_mutex_lock(&bulk->lock);
+			bulk->head++;
+			pthread_cond_signal(&bulk->freed);
+			continue;
+		}
+		for (size_t i = 0; i < batch->n_rows; i++) {
+			bulk_write_row(bulk, &batch->rows[i]);
+		}
+		// Write errors are sticky, so checking once per batch catches errors on any row
+		if (ferror(bulk->out)) {
+			perror("argon2_mariadb_bulk: write failed");
+			pthread_mutex_lock(&bulk->lock);
+			bulk->write_failed = true;
+			bulk->head++;
+			pthread_cond_signal(&bulk->freed);
+			continue;
+		}
+		if (bulk->progress) {
+			const double t = elapsed(&bulk->start);
+			if (t - last_report >= 1) {
+				fprintf(stderr, "argon2_mariadb_bulk: %zu rows, %.1f rows/s\n",
+						bulk->rows_written, bulk->rows_written / t);
+				last_report = t;
+			}
+		}
+
+		pthread_mutex_lock(&bulk->lock);
+		bulk->head++;
+		pthread_cond_signal(&bulk->freed);
+	}
+	if (!bulk->write_failed && fflush(bulk->out) != 0) {
+		perror("argon2_mariadb_bulk: write failed");
+		bulk->write_failed = true;
+	}
+	pthread_mutex_unlock(&bulk->lock);
+	return NULL;
+}
+
+// Read a line (without its line ending) into row, growing the row's buffer up to BULK_MAX_LINE_LEN.
+// The rest of longer lines is discarded and the row is marked too long.
+// Returns nonzero on EOF or error before any character was read.
+static int bulk_read_line(FILE *in, BulkRow *row) {
+	row->line_len = 0;
+	row->too_long = false;
+	if (row->line == NULL) {
+		if ((row->line = malloc(BULK_MIN_LINE_CAP)) == NULL) {
+			return 1;
+		}
+		row->line_cap = BULK_MIN_LINE_CAP;
+	}
+	int c;
+	while ((c = getc_unlocked(in)) != EOF && c != '\n') {
+		if (row->line_len == BULK_MAX_LINE_LEN) {
+			row->too_long = true;
+			continue;
+		}
+		if (row->line_len == row->line_cap) {
+			size_t cap = 2 * row->line_cap;
+			if (cap > BULK_MAX_LINE_LEN) {
+				cap = BULK_MAX_LINE_LEN;
+			}
+			char *line = realloc(row->line, cap);
+			if (line == NULL) {
+				row->too_long = true;
+				continue;
+			}
+			row->line = line;
+			row->line_cap = cap;
+		}
+		row->line[row->line_len++] = c;
+	}
+	if (c == EOF && row->line_len == 0 && !row->too_long) {
+		return 1;
+	}
+	// Strip CRLF line ending
+	if (row->line_len > 0 && row->line[row->line_len-1] == '\r') {
+		row->line_len--;
+	}
+	return 0;
+}
+
+// Read lines into the batches of the window until EOF
+static int bulk_read(Bulk *bulk) {
+	int status = 0;
+	bool eof = false;
+	while (!eof) {
+		pthread_mutex_lock(&bulk->lock);
+		while (bulk->tail - bulk->head == bulk->window_len) {
+			pthread_cond_wait(&bulk->freed, &bulk->lock);
+		}
+		if (bulk->write_failed) {
+			// Stop reading input which can't be written
+			bulk->eof = true;
+			pthread_cond_broadcast(&bulk->filled);
+			pthread_mutex_unlock(&bulk->lock);
+			break;
+		}
+		BulkBatch *batch = &bulk->window[bulk->tail % bulk->window_len];
+		pthread_mutex_unlock(&bulk->lock);
+
+		// Fill batch, reusing line allocations from previous batches
+		size_t n_rows = 0;
+		while (n_rows < bulk->batch_rows) {
+			if (bulk_read_line(bulk->in, &batch->rows[n_rows]) != 0) {
+				status = ferror(bulk->in);
+				eof = true;
+				break;
+			}
+			n_rows++;
+		}
+
+		pthread_mutex_lock(&bulk->lock);
+		if (n_rows > 0) {
+			batch->n_rows = n_rows;
+			batch->next_row = 0;
+			batch->done_rows = 0;
+			bulk->tail++;
+		}
+		bulk->eof = eof;
+		pthread_cond_broadcast(&bulk->filled);
+		pthread_mutex_unlock(&bulk->lock);
+	}
+	return status;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr,
+			"Usage: %s [-V] [-e encoding] [-d delim] [-k] [-j threads] [-b batch_rows] [-i input] [-o output] [-v] [-T]\n"
+			"  -V             verify hash<delim>password rows (output 1 or 0) instead of hashing params<delim>password rows\n"
+			"  -e encoding    ARGON2() encoding: 0 = std (default), 1 = raw (hex), 2 = hash only\n"
+			"  -d delim       field delimiter (default: tab, use , for CSV)\n"
+			"  -k             rows start with a key field, which is copied to the output\n"
+			"  -j threads     worker threads (default: number of online CPUs)\n"
+			"  -b batch_rows  rows per batch (default: %d)\n"
+			"  -i input       input file (default: stdin)\n"
+			"  -o output      output file (default: stdout)\n"
+			"  -v             report progress to stderr\n"
+			"  -T             dump recent phase timings to stderr on exit (requires a build with TRACE_RING)\n",
+			argv0, BULK_DEFAULT_BATCH_ROWS);
+}
+
+int main(int argc, char **argv) {
+	Bulk bulk = {
+		.encoding = ARGON2_encoding_std,
+		.delim = '\t',
+		.batch_rows = BULK_DEFAULT_BATCH_ROWS,
+		.in = stdin,
+		.out = stdout
+	};
+	long n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	int opt;
+	while ((opt = getopt(argc, argv, "Ve:d:kj:b:i:o:vTh")) != -1) {
+		switch (opt) {
+		case 'V':
+			bulk.verify = true;
+			break;
+		case 'e':
+			bulk.encoding = atoi(optarg);
+			if (bulk.encoding < ARGON2_encoding_std || bulk.encoding > ARGON2_encoding_hashonly) {
+				fprintf(stderr, "invalid encoding %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'd':
+			if (strlen(optarg) != 1 || optarg[0] == '$') {
+				fprintf(stderr, "delimiter must be a single character other than $\n");
+				return 1;
+			}
+			bulk.delim = optarg[0];
+			break;
+		case 'k':
+			bulk.key = true;
+			break;
+		case 'j':
+			n_threads = atol(optarg);
+			break;
+		case 'b':
+			bulk.batch_rows = atol(optarg);
+			break;
+		case 'i':
+			if ((bulk.in = fopen(optarg, "r")) == NULL) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		case 'o':
+			if ((bulk.out = fopen(optarg, "w")) == NULL) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		case 'v':
+			bulk.progress = true;
+			break;
+		case 'T':
+			bulk.trace = true;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (n_threads < 1 || bulk.batch_rows < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	// Two batches per worker keeps workers busy while the writer flushes
+	bulk.window_len = 2 * n_threads;
+	bulk.window = calloc(bulk.window_len, sizeof(BulkBatch));
+	for (size_t i = 0; i < bulk.window_len; i++) {
+		bulk.window[i].rows = calloc(bulk.batch_rows, sizeof(BulkRow));
+	}
+	pthread_mutex_init(&bulk.lock, NULL);
+	pthread_cond_init(&bulk.filled, NULL);
+	pthread_cond_init(&bulk.done, NULL);
+	pthread_cond_init(&bulk.freed, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &bulk.start);
+
+	pthread_t workers[n_threads], writer;
+	for (long i = 0; i < n_threads; i++) {
+		pthread_create(&workers[i], NULL, bulk_worker, &bulk);
+	}
+	pthread_create(&writer, NULL, bulk_writer, &bulk);
+
+	int status = bulk_read(&bulk);
+	if (status != 0) {
+		perror("argon2_mariadb_bulk: read failed");
+	}
+
+	for (long i = 0; i < n_threads; i++) {
+		pthread_join(workers[i], NULL);
+	}
+	pthread_join(writer, NULL);
+	if (bulk.write_failed) {
+		status = 1;
+	}
+
+	const double t = elapsed(&bulk.start);
+	fprintf(stderr, "argon2_mariadb_bulk: %zu rows (%zu failed) in %.2fs, %.1f rows/s\n",
+			bulk.rows_written, bulk.rows_failed, t, t > 0 ? bulk.rows_written / t : 0);
+	if (bulk.trace && argon2_mariadb_trace_dump(stderr) != 0) {
+		fprintf(stderr, "argon2_mariadb_bulk: built without TRACE_RING, no phase timings recorded\n");
+	}
+
+	for (size_t i = 0; i < bulk.window_len; i++) {
+		for (size_t j = 0; j < bulk.batch_rows; j++) {
+			free(bulk.window[i].rows[j].line);
+		}
+		free(bulk.window[i].rows);
+	}
+	free(bulk.window);
+	pthread_mutex_destroy(&bulk.lock);
+	pthread_cond_destroy(&bulk.filled);
+	pthread_cond_destroy(&bulk.done);
+	pthread_cond_destroy(&bulk.freed);
+	if (bulk.out != stdout && fclose(bulk.out) != 0) {
+		perror("argon2_mariadb_bulk: write failed");
+		status = 1;
+	}
+
+	return status != 0;
+}
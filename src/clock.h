@@ -0,0 +1,10 @@
+#pragma once
+#include <stdint.h>
+#include <time.h>
+
+// Monotonic time in nanoseconds, used to time phases and waits
+static inline uint64_t argon2_mariadb_now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
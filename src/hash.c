@@ -0,0 +1,125 @@
+#include "hash.h"
+#include "params.h"
+#include "trace.h"
+#include "matrix.h"
+#include <argon2.h>
+#include <base64.h>
+#include <openssl/crypto.h>
+#include <string.h>
+
+// Memory matrix allocation callbacks, used to mark phase boundaries inside of argon2_ctx().
+// argon2 has no boundary between the fill passes and finalization: the final block, tag and
+// matrix wipe all happen before the matrix is freed, so they are timed as part of fill.
+static int argon2_mariadb_allocate(uint8_t **memory, size_t bytes_to_allocate) {
+	const int code = argon2_mariadb_matrix_allocate(memory, bytes_to_allocate);
+	ARGON2_MARIADB_TRACE(alloc);
+	return code;
+}
+static void argon2_mariadb_deallocate(uint8_t *memory, size_t bytes_to_allocate) {
+	// The matrix is freed by argon2 once the tag is computed and the matrix is wiped
+	ARGON2_MARIADB_TRACE(fill);
+	argon2_mariadb_matrix_free(memory, bytes_to_allocate);
+}
+
+int argon2_mariadb_hash_raw(const Argon2MariaDBParams *params,
+		const void *pwd, const size_t pwd_len,
+		unsigned char *hash, const size_t hash_len) {
+	argon2_context ctx = {
+		.out = hash,
+		.outlen = hash_len,
+		.pwd = (uint8_t *)pwd,
+		.pwdlen = pwd_len,
+		.salt = (uint8_t *)params->salt,
+		.saltlen = sizeof(params->salt),
+		.t_cost = params->t_cost,
+		.m_cost = params->m_cost,
+		.lanes = params->parallelism,
+		.threads = params->parallelism,
+		.version = ARGON2_VERSION_NUMBER,
+		.allocate_cbk = &argon2_mariadb_allocate,
+		.free_cbk = &argon2_mariadb_deallocate,
+		.flags = ARGON2_DEFAULT_FLAGS
+	};
+	const int code = argon2_ctx(&ctx, params->mode);
+	ARGON2_MARIADB_TRACE(free);
+	return code;
+}
+
+size_t argon2_mariadb_encoded_len(const size_t encoded_params_len, const ARGON2_encoding encoding) {
+	switch (encoding) {
+	case ARGON2_encoding_std:
+		return encoded_params_len + (sizeof("$") - 1) + b64_nopadding_encoded_len(ARGON2_MARIADB_HASH_LEN);
+	case ARGON2_encoding_raw:
+		return ARGON2_MARIADB_HASH_LEN;
+	case ARGON2_encoding_hashonly:
+		return b64_nopadding_encoded_len(ARGON2_MARIADB_HASH_LEN);
+	}
+	return 0;
+}
+
+int argon2_mariadb_encode(const char *encoded_params, const size_t encoded_params_len,
+		const unsigned char *hash, const ARGON2_encoding encoding,
+		char *result, const size_t result_len) {
+	// Enforce proper size of result allocation
+	if (result_len != argon2_mariadb_encoded_len(encoded_params_len, encoding)) {
+		return 1;
+	}
+
+	switch (encoding) {
+	case ARGON2_encoding_std:
+		// Splice encoded params and hash
+		memcpy(result, encoded_params, encoded_params_len);
+		result[encoded_params_len] = '$';
+		const size_t offset = encoded_params_len + 1;
+		b64_nopadding_encode(hash, ARGON2_MARIADB_HASH_LEN, result + offset, result_len - offset);
+		break;
+	case ARGON2_encoding_raw:
+		memcpy(result, hash, ARGON2_MARIADB_HASH_LEN);
+		break;
+	case ARGON2_encoding_hashonly:
+		b64_nopadding_encode(hash, ARGON2_MARIADB_HASH_LEN, result, result_len);
+	}
+
+	return 0;
+}
+
+int argon2_mariadb_hash(const Argon2MariaDBParams *params,
+		const char *encoded_params, const size_t encoded_params_len,
+		const void *pwd, const size_t pwd_len, const ARGON2_encoding encoding,
+		char *result, size_t *result_len) {
+	// Compute raw hash
+	unsigned char hash[ARGON2_MARIADB_HASH_LEN];
+	const int code = argon2_mariadb_hash_raw(params, pwd, pwd_len, hash, sizeof(hash));
+	if (code != ARGON2_OK) {
+		return code;
+	}
+
+	// Encode hash
+	*result_len = argon2_mariadb_encoded_len(encoded_params_len, encoding);
+	if (argon2_mariadb_encode(encoded_params, encoded_params_len, hash, encoding,
+				result, *result_len) != 0) {
+		return ARGON2_ENCODING_FAIL;
+	}
+	ARGON2_MARIADB_TRACE(encode);
+
+	return ARGON2_OK;
+}
+
+int argon2_mariadb_verify(const Argon2MariaDBParams *params,
+		const unsigned char *hash, const size_t hash_len,
+		const void *pwd, const size_t pwd_len, bool *match) {
+	*match = false;
+	if (hash_len != ARGON2_MARIADB_HASH_LEN) {
+		return ARGON2_OUTPUT_TOO_SHORT;
+	}
+	// Hash provided password using params
+	unsigned char input_hash[ARGON2_MARIADB_HASH_LEN];
+	int code = argon2_mariadb_hash_raw(params, pwd, pwd_len, input_hash, sizeof(input_hash));
+	if (code != ARGON2_OK) {
+		return code;
+	}
+	// Compare hash result with correct hash
+	*match = CRYPTO_memcmp(input_hash, hash, hash_len) == 0;
+	ARGON2_MARIADB_TRACE(compare);
+	return ARGON2_OK;
+}
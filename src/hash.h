@@ -0,0 +1,46 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include "params.h"
+
+// An encoding option for hash output which can be supplied as an optional
+// third parameter to ARGON2()
+typedef enum {
+	ARGON2_encoding_std = 0,
+	ARGON2_encoding_raw = 1,
+	ARGON2_encoding_hashonly = 2
+} ARGON2_encoding;
+
+// Hash pwd using params, writing the raw hash to *hash.
+// Returns an argon2 error code.
+int argon2_mariadb_hash_raw(const Argon2MariaDBParams *params,
+		const void *pwd, const size_t pwd_len,
+		unsigned char *hash, const size_t hash_len);
+
+// Calculate the exact length of a hash encoded using encoding,
+// where encoded_params_len is the length of the params encoded using Argon2MariaDBParams_encode().
+size_t argon2_mariadb_encoded_len(const size_t encoded_params_len, const ARGON2_encoding encoding);
+// Encode a raw hash (ARGON2_MARIADB_HASH_LEN bytes) to result using encoding.
+// encoded_params is only used by ARGON2_encoding_std, which splices encoded_params and the encoded hash
+// into a full encoded hash string compatible with other Argon2 libraries.
+// No null termination is performed.
+int argon2_mariadb_encode(const char *encoded_params, const size_t encoded_params_len,
+		const unsigned char *hash, const ARGON2_encoding encoding,
+		char *result, const size_t result_len);
+
+// Hash pwd using params, and encode the result to result using encoding.
+// encoded_params must be params encoded using Argon2MariaDBParams_encode().
+// *result must have room for argon2_mariadb_encoded_len() bytes,
+// and *result_len is set to the length of the encoded hash.
+// Returns an argon2 error code.
+int argon2_mariadb_hash(const Argon2MariaDBParams *params,
+		const char *encoded_params, const size_t encoded_params_len,
+		const void *pwd, const size_t pwd_len, const ARGON2_encoding encoding,
+		char *result, size_t *result_len);
+
+// Hash pwd using params and compare the result with hash in constant time.
+// *match is set to whether the hashes are equal.
+// Returns an argon2 error code.
+int argon2_mariadb_verify(const Argon2MariaDBParams *params,
+		const unsigned char *hash, const size_t hash_len,
+		const void *pwd, const size_t pwd_len, bool *match);
@@ -0,0 +1,193 @@
+#include "matrix.h"
+#include "clock.h"
+#include <argon2.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+typedef struct {
+	uint8_t *memory;
+	size_t bytes;
+} RetainedMatrix;
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t freed; // Signaled when resident memory shrinks
+	RetainedMatrix retained[ARGON2_MARIADB_MATRIX_RETAIN_MAX];
+	size_t retained_count, retained_max;
+	size_t retain_bytes; // Size of retained matrices
+	// Resident memory is the sum of matrices in use and retained matrices
+	size_t in_use_bytes, retained_bytes;
+	size_t budget_bytes; // 0 is unlimited
+	// Waiting allocations are admitted in FIFO order
+	uint64_t next_ticket, serving_ticket;
+	// Counters
+	size_t waiting, in_use;
+	uint64_t admitted, wait_ns_total, wait_ns_max;
+} matrices = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.freed = PTHREAD_COND_INITIALIZER
+};
+static pthread_once_t matrices_once = PTHREAD_ONCE_INIT;
+
+static void matrices_init() {
+	const char *value = getenv("ARGON2_MARIADB_MEMORY_BUDGET");
+	if (value != NULL) {
+		matrices.budget_bytes = strtoull(value, NULL, 10) * 1024;
+	}
+}
+
+// Matrices are mapped directly so that retained matrices can be made reclaimable using madvise()
+static uint8_t *matrix_map(const size_t bytes) {
+	void *memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return memory == MAP_FAILED ? NULL : memory;
+}
+
+// Whether bytes more fit in the budget. matrices.lock must be held.
+static bool matrix_fits(const size_t bytes) {
+	return matrices.budget_bytes == 0 ||
+		matrices.in_use_bytes + matrices.retained_bytes + bytes <= matrices.budget_bytes;
+}
+
+// Unmap the oldest retained matrix. matrices.lock must be held.
+static void matrix_evict() {
+	const RetainedMatrix evicted = matrices.retained[0];
+	matrices.retained_count--;
+	for (size_t i = 0; i < matrices.retained_count; i++) {
+		matrices.retained[i] = matrices.retained[i + 1];
+	}
+	matrices.retained_bytes -= evicted.bytes;
+	munmap(evicted.memory, evicted.bytes);
+}
+
+// Retain memory if there is room. matrices.lock must be held.
+// Returns nonzero if memory was not retained.
+static int matrix_retain(uint8_t *memory, const size_t bytes) {
+	// Only matrices of the retained size are ever reused, others would hold a slot forever
+	if (bytes != matrices.retain_bytes || matrices.retained_count >= matrices.retained_max ||
+			!matrix_fits(bytes)) {
+		return 1;
+	}
+#ifdef MADV_FREE
+	// Let the kernel reclaim idle matrices under memory pressure.
+	// Pages which aren't reclaimed stay mapped, and are reused without faulting.
+	madvise(memory, bytes, MADV_FREE);
+#endif
+	matrices.retained[matrices.retained_count++] = (RetainedMatrix){memory, bytes};
+	matrices.retained_bytes += bytes;
+	return 0;
+}
+
+int argon2_mariadb_matrix_allocate(uint8_t **memory, size_t bytes) {
+	pthread_once(&matrices_once, matrices_init);
+	*memory = NULL;
+
+	pthread_mutex_lock(&matrices.lock);
+	// Reuse a retained matrix (which is already resident)
+	for (size_t i = matrices.retained_count; i-- > 0;) {
+		if (matrices.retained[i].bytes == bytes) {
+			*memory = matrices.retained[i].memory;
+			matrices.retained[i] = matrices.retained[--matrices.retained_count];
+			matrices.retained_bytes -= bytes;
+			break;
+		}
+	}
+	if (*memory == NULL) {
+		// Wait until the matrix fits in the budget, evicting retained matrices first.
+		// A matrix is always admitted when no others are in use, so that hashes exceeding
+		// the budget can still make progress.
+		const uint64_t start = argon2_mariadb_now_ns();
+		const uint64_t ticket = matrices.next_ticket++;
+		matrices.waiting++;
+		for (;;) {
+			if (ticket == matrices.serving_ticket) {
+				if (matrix_fits(bytes) || matrices.in_use == 0) {
+					break;
+				}
+				if (matrices.retained_count > 0) {
+					matrix_evict();
+					continue;
+				}
+			}
+			pthread_cond_wait(&matrices.freed, &matrices.lock);
+		}
+		matrices.serving_ticket++;
+		matrices.waiting--;
+		// Let the next ticket proceed
+		pthread_cond_broadcast(&matrices.freed);
+		const uint64_t wait_ns = argon2_mariadb_now_ns() - start;
+		matrices.wait_ns_total += wait_ns;
+		if (wait_ns > matrices.wait_ns_max) {
+			matrices.wait_ns_max = wait_ns;
+		}
+	}
+	matrices.in_use++;
+	matrices.in_use_bytes += bytes;
+	matrices.admitted++;
+	pthread_mutex_unlock(&matrices.lock);
+
+	if (*memory == NULL && (*memory = matrix_map(bytes)) == NULL) {
+		argon2_mariadb_matrix_free(NULL, bytes);
+		return ARGON2_MEMORY_ALLOCATION_ERROR;
+	}
+	return ARGON2_OK;
+}
+
+void argon2_mariadb_matrix_free(uint8_t *memory, size_t bytes) {
+	pthread_mutex_lock(&matrices.lock);
+	matrices.in_use--;
+	matrices.in_use_bytes -= bytes;
+	if (memory != NULL && matrix_retain(memory, bytes) != 0) {
+		munmap(memory, bytes);
+	}
+	pthread_cond_broadcast(&matrices.freed);
+	pthread_mutex_unlock(&matrices.lock);
+}
+
+void argon2_mariadb_matrix_retain(size_t n, size_t bytes) {
+	if (n > ARGON2_MARIADB_MATRIX_RETAIN_MAX) {
+		n = ARGON2_MARIADB_MATRIX_RETAIN_MAX;
+	}
+	pthread_mutex_lock(&matrices.lock);
+	// Matrices of another size are all evicted
+	const size_t keep = bytes == matrices.retain_bytes ? n : 0;
+	while (matrices.retained_count > keep) {
+		matrix_evict();
+	}
+	matrices.retained_max = n;
+	matrices.retain_bytes = bytes;
+	pthread_mutex_unlock(&matrices.lock);
+}
+
+int argon2_mariadb_matrix_prefault(size_t bytes) {
+	pthread_once(&matrices_once, matrices_init);
+	uint8_t *memory = matrix_map(bytes);
+	if (memory == NULL) {
+		return 1;
+	}
+	// Touch every page
+	const long page_size = sysconf(_SC_PAGESIZE);
+	for (size_t i = 0; i < bytes; i += page_size) {
+		((volatile uint8_t *)memory)[i] = 0;
+	}
+	pthread_mutex_lock(&matrices.lock);
+	const int status = matrix_retain(memory, bytes);
+	pthread_mutex_unlock(&matrices.lock);
+	if (status != 0) {
+		munmap(memory, bytes);
+	}
+	return status;
+}
+
+size_t argon2_mariadb_matrix_stats(char *result, const size_t result_len) {
+	pthread_mutex_lock(&matrices.lock);
+	const size_t len = snprintf(result, result_len, "memory\t%zu\t%zu\t%llu\t%llu\t%llu\n",
+			matrices.waiting, matrices.in_use, (unsigned long long)matrices.admitted,
+			(unsigned long long)(matrices.wait_ns_total / 1000), (unsigned long long)(matrices.wait_ns_max / 1000));
+	pthread_mutex_unlock(&matrices.lock);
+	return len;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Memory matrix allocation for argon2_ctx() (see argon2_context.allocate_cbk and free_cbk).
+//
+// Freed matrices of a single size can be retained for reuse by later hashes of that size,
+// which avoids page faulting a fresh matrix on every call. No matrices are retained by default.
+// Retained matrices are marked reclaimable (MADV_FREE), so the kernel may take them back under memory pressure.
+//
+// Peak resident memory can be bounded by setting ARGON2_MARIADB_MEMORY_BUDGET (KiB) in the environment
+// of the server. Allocations which don't fit in the budget first evict retained matrices,
+// and then wait for matrices in use to be freed, so that excess hashes are suspended before their first pass.
+// Matrices are always allocated when no others are in use.
+
+// Max number of matrices which can be retained
+#define ARGON2_MARIADB_MATRIX_RETAIN_MAX 64
+
+// Allocate a matrix of bytes, reusing a retained matrix if one is available,
+// and waiting for the matrix to fit in the memory budget.
+// Returns an argon2 error code.
+int argon2_mariadb_matrix_allocate(uint8_t **memory, size_t bytes);
+// Free or retain a matrix of bytes. Matrices are wiped by argon2 before being freed.
+void argon2_mariadb_matrix_free(uint8_t *memory, size_t bytes);
+
+// Retain up to n freed matrices of bytes (n is capped to ARGON2_MARIADB_MATRIX_RETAIN_MAX),
+// evicting retained matrices of any other size. Matrices of other sizes are never retained.
+// argon2_mariadb_matrix_retain(0, 0) releases all retained matrices.
+void argon2_mariadb_matrix_retain(size_t n, size_t bytes);
+// Allocate and pre-fault a matrix of bytes, and retain it.
+// Returns nonzero on failure, or if no more matrices can be retained.
+int argon2_mariadb_matrix_prefault(size_t bytes);
+
+// Write matrix allocation counters to result in the form
+// memory\twaiting\tin_use\tadmitted\twait_us_total\twait_us_max.
+// Returns the length of the full output (which may exceed result_len), as snprintf() does.
+size_t argon2_mariadb_matrix_stats(char *result, const size_t result_len);
@@ -0,0 +1,161 @@
+#include "scheduler.h"
+#include "clock.h"
+#include "params.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define N_CLASSES 2
+
+static const char *const class_names[N_CLASSES] = {"interactive", "batch"};
+
+typedef struct {
+	pthread_cond_t cond; // Signaled when calls of this class may be admitted
+	// Calls within a class are admitted in FIFO order
+	uint64_t next_ticket, serving_ticket;
+	size_t waiting; // Queue depth
+	size_t running;
+	uint64_t admitted;
+	uint64_t wait_ns_total, wait_ns_max;
+} SchedClass;
+
+static struct {
+	pthread_mutex_t lock;
+	SchedClass classes[N_CLASSES];
+	uint64_t cores_max, cores_used;
+	uint64_t batch_cores_max, batch_cores_used;
+	uint64_t batch_memory_max, batch_memory_used; // KiB, a max of 0 is unlimited
+} sched = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.classes = {
+		{.cond = PTHREAD_COND_INITIALIZER},
+		{.cond = PTHREAD_COND_INITIALIZER}
+	}
+};
+static pthread_once_t sched_once = PTHREAD_ONCE_INIT;
+
+static uint64_t getenv_u64(const char *name, const uint64_t default_value) {
+	const char *value = getenv(name);
+	if (value == NULL || *value == '\0') {
+		return default_value;
+	}
+	return strtoull(value, NULL, 10);
+}
+
+static void sched_init() {
+	const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	sched.cores_max = getenv_u64("ARGON2_MARIADB_POOL_CORES", n_cpus > 0 ? n_cpus : 1);
+	if (sched.cores_max == 0) {
+		sched.cores_max = 1;
+	}
+	sched.batch_cores_max = getenv_u64("ARGON2_MARIADB_BATCH_CORES", (sched.cores_max + 1) / 2);
+	sched.batch_memory_max = getenv_u64("ARGON2_MARIADB_BATCH_MEMORY", 0);
+}
+
+// Cores used by a hash, which is the number of threads argon2 runs it with
+static uint64_t sched_cores(const Argon2MariaDBParams *params) {
+#ifdef ARGON2_NO_THREADS
+	return 1;
+#else
+	return params->parallelism;
+#endif
+}
+
+// Whether a hash of class using cores and memory KiB can be admitted. sched.lock must be held.
+static bool sched_admissible(const Argon2MariaDBClass class, const uint64_t cores, const uint64_t memory) {
+	const SchedClass *interactive = &sched.classes[ARGON2_MARIADB_CLASS_interactive];
+	const SchedClass *batch = &sched.classes[ARGON2_MARIADB_CLASS_batch];
+	if (class == ARGON2_MARIADB_CLASS_batch) {
+		// Batch calls always yield to waiting interactive calls
+		if (interactive->waiting > 0) {
+			return false;
+		}
+		// Enforce batch caps, unless no batch calls are running
+		// (so that a single hash exceeding the caps can still make progress)
+		if (batch->running > 0 &&
+				(sched.batch_cores_used + cores > sched.batch_cores_max ||
+				(sched.batch_memory_max != 0 && sched.batch_memory_used + memory > sched.batch_memory_max))) {
+			return false;
+		}
+	}
+	// Always admit into an idle pool, for the same reason
+	return sched.cores_used == 0 || sched.cores_used + cores <= sched.cores_max;
+}
+
+// Wake waiters that may now be admissible. sched.lock must be held.
+static void sched_wake() {
+	if (sched.classes[ARGON2_MARIADB_CLASS_interactive].waiting > 0) {
+		pthread_cond_broadcast(&sched.classes[ARGON2_MARIADB_CLASS_interactive].cond);
+	} else if (sched.classes[ARGON2_MARIADB_CLASS_batch].waiting > 0) {
+		pthread_cond_broadcast(&sched.classes[ARGON2_MARIADB_CLASS_batch].cond);
+	}
+}
+
+void argon2_mariadb_sched_acquire(const Argon2MariaDBClass class, const Argon2MariaDBParams *params) {
+	pthread_once(&sched_once, sched_init);
+	const uint64_t cores = sched_cores(params);
+	const uint64_t memory = params->m_cost;
+	SchedClass *c = &sched.classes[class];
+
+	pthread_mutex_lock(&sched.lock);
+	const uint64_t start = argon2_mariadb_now_ns();
+	const uint64_t ticket = c->next_ticket++;
+	c->waiting++;
+	while (ticket != c->serving_ticket || !sched_admissible(class, cores, memory)) {
+		pthread_cond_wait(&c->cond, &sched.lock);
+	}
+	c->serving_ticket++;
+	c->waiting--;
+	c->running++;
+	sched.cores_used += cores;
+	if (class == ARGON2_MARIADB_CLASS_batch) {
+		sched.batch_cores_used += cores;
+		sched.batch_memory_used += memory;
+	}
+
+	const uint64_t wait_ns = argon2_mariadb_now_ns() - start;
+	c->admitted++;
+	c->wait_ns_total += wait_ns;
+	if (wait_ns > c->wait_ns_max) {
+		c->wait_ns_max = wait_ns;
+	}
+	// The next call of this class, or batch calls held back only by this call, may now be admissible
+	sched_wake();
+	if (c->waiting > 0) {
+		pthread_cond_broadcast(&c->cond);
+	}
+	pthread_mutex_unlock(&sched.lock);
+}
+
+void argon2_mariadb_sched_release(const Argon2MariaDBClass class, const Argon2MariaDBParams *params) {
+	const uint64_t cores = sched_cores(params);
+	const uint64_t memory = params->m_cost;
+
+	pthread_mutex_lock(&sched.lock);
+	sched.classes[class].running--;
+	sched.cores_used -= cores;
+	if (class == ARGON2_MARIADB_CLASS_batch) {
+		sched.batch_cores_used -= cores;
+		sched.batch_memory_used -= memory;
+	}
+	sched_wake();
+	pthread_mutex_unlock(&sched.lock);
+}
+
+size_t argon2_mariadb_sched_stats(char *result, const size_t result_len) {
+	size_t len = 0;
+	pthread_mutex_lock(&sched.lock);
+	for (int i = 0; i < N_CLASSES; i++) {
+		const SchedClass *c = &sched.classes[i];
+		len += snprintf(result + (len < result_len ? len : result_len),
+				len < result_len ? result_len - len : 0,
+				"%s\t%zu\t%zu\t%llu\t%llu\t%llu\n", class_names[i], c->waiting, c->running,
+				(unsigned long long)c->admitted,
+				(unsigned long long)(c->wait_ns_total / 1000), (unsigned long long)(c->wait_ns_max / 1000));
+	}
+	pthread_mutex_unlock(&sched.lock);
+	return len;
+}
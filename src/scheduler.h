@@ -0,0 +1,32 @@
+#pragma once
+#include <stddef.h>
+#include "params.h"
+
+// Admission scheduler shared by all hashing UDF calls.
+//
+// Hashing calls run on server threads, but must acquire a slot from a shared pool of cores
+// (one core per argon2 thread) before hashing. Latency sensitive (interactive) calls always
+// take precedence over waiting batch calls, and batch calls are additionally capped to a share
+// of the pool's cores and memory. Batch calls release their slot after every hash, yielding
+// to any interactive calls which queued up in the meantime.
+//
+// The pool is configured from the environment of the server when first used:
+// - ARGON2_MARIADB_POOL_CORES: cores in the pool (default: number of online CPUs)
+// - ARGON2_MARIADB_BATCH_CORES: max cores used by batch calls (default: half of the pool)
+// - ARGON2_MARIADB_BATCH_MEMORY: max memory in KiB used by batch calls (default: 0 = unlimited)
+
+// Priority classes, which can be supplied as an optional argument to ARGON2() and ARGON2_VERIFY()
+typedef enum {
+	ARGON2_MARIADB_CLASS_interactive = 0, // Latency sensitive calls (i.e logins), the default
+	ARGON2_MARIADB_CLASS_batch = 1 // Bulk jobs (i.e rehashing or migrations)
+} Argon2MariaDBClass;
+
+// Block until a hash using params may run in class.
+void argon2_mariadb_sched_acquire(const Argon2MariaDBClass class, const Argon2MariaDBParams *params);
+// Release the slot acquired by argon2_mariadb_sched_acquire().
+void argon2_mariadb_sched_release(const Argon2MariaDBClass class, const Argon2MariaDBParams *params);
+
+// Write per-class counters to result, one class per line in the form
+// class\twaiting\trunning\tadmitted\twait_us_total\twait_us_max.
+// Returns the length of the full output (which may exceed result_len), as snprintf() does.
+size_t argon2_mariadb_sched_stats(char *result, const size_t result_len);
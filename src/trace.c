@@ -0,0 +1,163 @@
+#include "trace.h"
+#include "clock.h"
+#include <stdio.h>
+
+_Thread_local Argon2MariaDBTraceFn argon2_mariadb_trace_fn;
+
+#ifdef ARGON2_MARIADB_TRACE_RING
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Number of phases retained per thread
+#define TRACE_RING_LEN 256
+// Longest line written by argon2_mariadb_trace_dump():
+// ring id (10), fn (13), phase (8), end_ns (20), duration_ns (20), tabs and newline (5)
+#define TRACE_LINE_MAX_LEN 76
+
+static const char *const trace_fn_names[] = {
+	"ARGON2", "ARGON2_VERIFY", "ARGON2_PARAMS"
+};
+static const char *const trace_phase_names[] = {
+	"start", "decode", "queue", "gensalt", "alloc", "fill", "free", "encode", "compare", "done"
+};
+
+// Entries are written by the owning thread only, and read by dumping threads
+// using a per-entry sequence number (seqlock): seq is odd while the entry is
+// being written, and 2 * (index + 1) once entry index has been written.
+typedef struct {
+	_Atomic uint64_t seq;
+	_Atomic uint64_t end_ns;
+	// duration_ns << 16 | fn << 8 | phase
+	_Atomic uint64_t meta;
+} TraceEntry;
+
+typedef struct TraceRing {
+	TraceEntry entries[TRACE_RING_LEN];
+	// Total number of entries written
+	_Atomic uint64_t head;
+	// Whether the ring is owned by a live thread
+	atomic_bool in_use;
+	unsigned int id;
+	// Timestamp of the previous mark
+	uint64_t last_ns;
+	struct TraceRing *next;
+} TraceRing;
+
+// All rings ever allocated. Rings of exited threads are reused, and all rings are freed when the library is unloaded.
+static _Atomic(TraceRing *) trace_rings;
+static atomic_uint trace_ring_count;
+static pthread_key_t trace_ring_key;
+static bool trace_ring_key_created = false;
+static pthread_once_t trace_ring_once = PTHREAD_ONCE_INIT;
+static _Thread_local TraceRing *trace_ring;
+
+static void trace_ring_release(void *ring) {
+	atomic_store(&((TraceRing *)ring)->in_use, false);
+}
+
+static void trace_ring_init() {
+	trace_ring_key_created = pthread_key_create(&trace_ring_key, trace_ring_release) == 0;
+}
+
+// The key's destructor must not outlive the library (i.e after DROP FUNCTION unloads the plugin),
+// since server threads exiting later would call into unmapped code
+__attribute__((destructor))
+static void trace_ring_fini() {
+	if (trace_ring_key_created) {
+		pthread_key_delete(trace_ring_key);
+	}
+	TraceRing *ring = atomic_exchange(&trace_rings, NULL);
+	while (ring != NULL) {
+		TraceRing *next = ring->next;
+		free(ring);
+		ring = next;
+	}
+}
+
+static TraceRing *trace_ring_acquire() {
+	pthread_once(&trace_ring_once, trace_ring_init);
+	// Reuse the ring of an exited thread
+	TraceRing *ring;
+	for (ring = atomic_load(&trace_rings); ring != NULL; ring = ring->next) {
+		bool in_use = false;
+		if (atomic_compare_exchange_strong(&ring->in_use, &in_use, true)) {
+			break;
+		}
+	}
+	// Allocate a new ring
+	if (ring == NULL) {
+		ring = calloc(1, sizeof(TraceRing));
+		if (ring == NULL) {
+			return NULL;
+		}
+		atomic_store(&ring->in_use, true);
+		ring->id = atomic_fetch_add(&trace_ring_count, 1);
+		ring->next = atomic_load(&trace_rings);
+		while (!atomic_compare_exchange_weak(&trace_rings, &ring->next, ring));
+	}
+	if (trace_ring_key_created) {
+		pthread_setspecific(trace_ring_key, ring);
+	}
+	return ring;
+}
+
+void argon2_mariadb_trace_mark(const Argon2MariaDBTracePhase phase) {
+	if (trace_ring == NULL && (trace_ring = trace_ring_acquire()) == NULL) {
+		return;
+	}
+	TraceRing *ring = trace_ring;
+	const uint64_t now = argon2_mariadb_now_ns();
+	const uint64_t duration = phase == ARGON2_MARIADB_TRACE_start ? 0 : now - ring->last_ns;
+	ring->last_ns = now;
+
+	const uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	TraceEntry *entry = &ring->entries[head % TRACE_RING_LEN];
+	atomic_store_explicit(&entry->seq, 2 * head + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&entry->end_ns, now, memory_order_relaxed);
+	atomic_store_explicit(&entry->meta, duration << 16 | argon2_mariadb_trace_fn << 8 | phase,
+			memory_order_relaxed);
+	atomic_store_explicit(&entry->seq, 2 * (head + 1), memory_order_release);
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+int argon2_mariadb_trace_dump(FILE *f) {
+	for (TraceRing *ring = atomic_load(&trace_rings); ring != NULL; ring = ring->next) {
+		const uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+		const uint64_t first = head > TRACE_RING_LEN ? head - TRACE_RING_LEN : 0;
+		for (uint64_t i = first; i < head; i++) {
+			TraceEntry *entry = &ring->entries[i % TRACE_RING_LEN];
+			const uint64_t seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+			const uint64_t end_ns = atomic_load_explicit(&entry->end_ns, memory_order_relaxed);
+			const uint64_t meta = atomic_load_explicit(&entry->meta, memory_order_relaxed);
+			atomic_thread_fence(memory_order_acquire);
+			// Skip entries that were overwritten while reading
+			if (seq != 2 * (i + 1) || atomic_load_explicit(&entry->seq, memory_order_relaxed) != seq) {
+				continue;
+			}
+			const unsigned int fn = (meta >> 8) & 0xff, phase = meta & 0xff;
+			fprintf(f, "%u\t%s\t%s\t%llu\t%llu\n", ring->id, trace_fn_names[fn], trace_phase_names[phase],
+					(unsigned long long)end_ns, (unsigned long long)(meta >> 16));
+		}
+	}
+	return 0;
+}
+
+size_t argon2_mariadb_trace_dump_max_len() {
+	return (size_t)atomic_load(&trace_ring_count) * TRACE_RING_LEN * TRACE_LINE_MAX_LEN;
+}
+
+#else
+
+int argon2_mariadb_trace_dump(FILE *f) {
+	return 1;
+}
+
+size_t argon2_mariadb_trace_dump_max_len() {
+	return 0;
+}
+
+#endif
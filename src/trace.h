@@ -0,0 +1,75 @@
+#pragma once
+#include <stdio.h>
+
+// Static tracepoints (USDT) and an optional per-thread ring buffer of phase timings.
+//
+// Each UDF call fires the argon2_mariadb:start probe, followed by one probe per
+// completed phase (i.e argon2_mariadb:decode when params decoding is done), and finally
+// argon2_mariadb:done. arg0 of every probe is the traced function (Argon2MariaDBTraceFn).
+// Probes compile to a single nop when <sys/sdt.h> is available, and to nothing otherwise.
+//
+// When built with TRACE_RING (-DARGON2_MARIADB_TRACE_RING), the duration of each phase
+// is also recorded to a lock-free ring buffer owned by the calling thread,
+// which can be dumped using argon2_mariadb_trace_dump().
+
+// Traced functions
+typedef enum {
+	ARGON2_MARIADB_TRACE_FN_ARGON2 = 0,
+	ARGON2_MARIADB_TRACE_FN_ARGON2_VERIFY = 1,
+	ARGON2_MARIADB_TRACE_FN_ARGON2_PARAMS = 2
+} Argon2MariaDBTraceFn;
+
+// Phase boundaries, each phase is timed from the previous boundary
+typedef enum {
+	ARGON2_MARIADB_TRACE_start = 0,
+	ARGON2_MARIADB_TRACE_decode, // Params and/or hash decoding
+	ARGON2_MARIADB_TRACE_queue, // Waiting for a hashing slot
+	ARGON2_MARIADB_TRACE_gensalt, // Salt generation
+	ARGON2_MARIADB_TRACE_alloc, // Memory matrix allocation
+	ARGON2_MARIADB_TRACE_fill, // Initial blocks, fill passes, final block and tag computation, and matrix wipe
+	ARGON2_MARIADB_TRACE_free, // Freeing (or retaining) the matrix
+	ARGON2_MARIADB_TRACE_encode, // Output encoding
+	ARGON2_MARIADB_TRACE_compare, // Hash comparison
+	ARGON2_MARIADB_TRACE_done
+} Argon2MariaDBTracePhase;
+
+// Function currently being traced on this thread
+extern _Thread_local Argon2MariaDBTraceFn argon2_mariadb_trace_fn;
+
+#if defined(__has_include) && !defined(ARGON2_MARIADB_NO_USDT)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define ARGON2_MARIADB_PROBE(phase) DTRACE_PROBE1(argon2_mariadb, phase, argon2_mariadb_trace_fn)
+#endif
+#endif
+#ifndef ARGON2_MARIADB_PROBE
+#define ARGON2_MARIADB_PROBE(phase)
+#endif
+
+#ifdef ARGON2_MARIADB_TRACE_RING
+// Record the end of phase to the calling thread's ring buffer
+void argon2_mariadb_trace_mark(const Argon2MariaDBTracePhase phase);
+#define ARGON2_MARIADB_RING_MARK(phase) argon2_mariadb_trace_mark(ARGON2_MARIADB_TRACE_##phase)
+#else
+#define ARGON2_MARIADB_RING_MARK(phase)
+#endif
+
+// Mark the start of a call to fn
+#define ARGON2_MARIADB_TRACE_START(fn) do { \
+	argon2_mariadb_trace_fn = ARGON2_MARIADB_TRACE_FN_##fn; \
+	ARGON2_MARIADB_PROBE(start); \
+	ARGON2_MARIADB_RING_MARK(start); \
+} while (0)
+// Mark the end of phase
+#define ARGON2_MARIADB_TRACE(phase) do { \
+	ARGON2_MARIADB_PROBE(phase); \
+	ARGON2_MARIADB_RING_MARK(phase); \
+} while (0)
+
+// Write the contents of all ring buffers to f, one phase per line in the form
+// ring\tfn\tphase\tend_ns\tduration_ns (oldest first within each ring).
+// Returns nonzero if the ring buffer was not built in.
+int argon2_mariadb_trace_dump(FILE *f);
+// Upper bound on the length of argon2_mariadb_trace_dump() output for the rings allocated so far
+// (rings allocated afterwards can make the output longer). Returns 0 if the ring buffer was not built in.
+size_t argon2_mariadb_trace_dump_max_len();
@@ -0,0 +1,85 @@
+#include "params.h"
+#include "hash.h"
+#include "matrix.h"
+#include "scheduler.h"
+#include "clock.h"
+#include <argon2.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Optional warm-up when the plugin is loaded by the server, so that the first calls after a
+// restart or failover don't pay for page faulting fresh matrices or initializing the CSPRNG.
+//
+// Enabled by setting ARGON2_MARIADB_WARMUP=n in the environment of the server, which (in the background):
+// - Pre-faults n matrices for ARGON2_MARIADB_DEFAULT_PARAMS and retains them for reuse by later calls
+//   (n * 64MiB of memory stays resident for the lifetime of the plugin)
+// - Primes the CSPRNG used by ARGON2_PARAMS()
+// - Runs one calibration hash using ARGON2_MARIADB_DEFAULT_PARAMS in each mode
+
+static pthread_t warmup_thread;
+static bool warmup_started = false;
+
+static void *warmup(void *arg) {
+	const size_t n_matrices = (size_t)arg;
+	const size_t matrix_bytes = (size_t)ARGON2_MARIADB_DEFAULT_PARAMS.m_cost * ARGON2_BLOCK_SIZE;
+	const uint64_t start = argon2_mariadb_now_ns();
+
+	// Pre-fault matrices (stops early if calls already filled the retained matrices)
+	argon2_mariadb_matrix_retain(n_matrices, matrix_bytes);
+	size_t prefaulted = 0;
+	while (prefaulted < n_matrices && argon2_mariadb_matrix_prefault(matrix_bytes) == 0) {
+		prefaulted++;
+	}
+
+	// Prime CSPRNG
+	Argon2MariaDBParams params;
+	Argon2MariaDBParams_default(&params);
+	if (Argon2MariaDBParams_gensalt(&params) != 0) {
+		fprintf(stderr, "argon2_mariadb: warm-up failed to generate a salt\n");
+		return NULL;
+	}
+
+	// Calibration hashes, scheduled as batch work so they never delay real calls
+	for (argon2_type mode = ARGON2_MARIADB_MIN_PARAMS.mode; mode <= ARGON2_MARIADB_MAX_PARAMS.mode; mode++) {
+		params.mode = mode;
+		unsigned char hash[ARGON2_MARIADB_HASH_LEN];
+		const uint64_t hash_start = argon2_mariadb_now_ns();
+		argon2_mariadb_sched_acquire(ARGON2_MARIADB_CLASS_batch, &params);
+		const int code = argon2_mariadb_hash_raw(&params, "", 0, hash, sizeof(hash));
+		argon2_mariadb_sched_release(ARGON2_MARIADB_CLASS_batch, &params);
+		if (code != ARGON2_OK) {
+			fprintf(stderr, "argon2_mariadb: warm-up %s calibration hash failed: %s\n",
+					argon2_type2string(mode, 0), argon2_error_message(code));
+			continue;
+		}
+		fprintf(stderr, "argon2_mariadb: %s calibration hash took %.1fms\n",
+				argon2_type2string(mode, 0), (argon2_mariadb_now_ns() - hash_start) / 1e6);
+	}
+
+	fprintf(stderr, "argon2_mariadb: warm-up complete in %.1fms, %zu matrices pre-faulted (up to %zu retained)\n",
+			(argon2_mariadb_now_ns() - start) / 1e6, prefaulted, n_matrices);
+	return NULL;
+}
+
+__attribute__((constructor))
+static void warmup_start() {
+	const char *value = getenv("ARGON2_MARIADB_WARMUP");
+	if (value == NULL || *value == '\0') {
+		return;
+	}
+	const size_t n_matrices = strtoull(value, NULL, 10);
+	// Don't block loading the plugin
+	warmup_started = pthread_create(&warmup_thread, NULL, warmup, (void *)n_matrices) == 0;
+}
+
+__attribute__((destructor))
+static void warmup_stop() {
+	// The plugin can't be unloaded while warm-up is still running
+	if (warmup_started) {
+		pthread_join(warmup_thread, NULL);
+		// Release retained matrices, which would otherwise leak on every unload
+		argon2_mariadb_matrix_retain(0, 0);
+	}
+}